@@ -0,0 +1,336 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "tree_generator.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+
+namespace {
+
+const char* const MARKER_NAME = ".os_find_bench";
+
+struct Scenario {
+    const char* name;
+    std::vector<string> args;
+};
+
+struct RunResult {
+    double wall_ms;
+    double user_ms;
+    double sys_ms;
+    long max_rss_kb;
+    uint64_t syscalls;
+    uint64_t results;
+    int exit_code;
+};
+
+void print_error(string const& what) {
+    cerr << what << endl;
+    cerr << strerror(errno) << endl;
+}
+
+double now_ms() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<double>(ts.tv_sec) * 1e3 + static_cast<double>(ts.tv_nsec) / 1e6;
+}
+
+double to_ms(timeval const& tv) {
+    return static_cast<double>(tv.tv_sec) * 1e3 + static_cast<double>(tv.tv_usec) / 1e3;
+}
+
+string read_fd(int fd) {
+    string result;
+    char buf[64 * 1024];
+    lseek(fd, 0, SEEK_SET);
+    ssize_t read_bytes;
+    while ((read_bytes = read(fd, buf, sizeof(buf))) > 0) {
+        result.append(buf, static_cast<size_t>(read_bytes));
+    }
+    return result;
+}
+
+// sums every "calls":N of the --stats-json report
+uint64_t count_syscalls(string const& report) {
+    const string key = "\"calls\":";
+    uint64_t total = 0;
+    for (size_t pos = report.find(key); pos != string::npos; pos = report.find(key, pos)) {
+        pos += key.size();
+        total += std::strtoull(report.c_str() + pos, nullptr, 10);
+    }
+    return total;
+}
+
+uint64_t count_lines(int fd) {
+    uint64_t lines = 0;
+    char buf[64 * 1024];
+    lseek(fd, 0, SEEK_SET);
+    ssize_t read_bytes;
+    while ((read_bytes = read(fd, buf, sizeof(buf))) > 0) {
+        lines += static_cast<uint64_t>(std::count(buf, buf + read_bytes, '\n'));
+    }
+    return lines;
+}
+
+void drop_caches() {
+    sync();
+    std::ofstream control("/proc/sys/vm/drop_caches");
+    control << "3" << endl;
+    if (!control) {
+        cerr << "Cannot drop caches, running warm" << endl;
+    }
+}
+
+bool run(string const& os_find, std::vector<string> const& args, RunResult& result) {
+    // stdout and stderr of the child go to memory files, so that
+    // the measured run is not slowed down by a reader on a pipe
+    int out = memfd_create("os_find_out", MFD_CLOEXEC);
+    int err = memfd_create("os_find_err", MFD_CLOEXEC);
+    if (out == -1 || err == -1) {
+        print_error("Error creating output files");
+        return false;
+    }
+
+    std::vector<char*> c_args;
+    c_args.push_back(const_cast<char*>(os_find.c_str()));
+    for (auto const& arg : args) {
+        c_args.push_back(const_cast<char*>(arg.c_str()));
+    }
+    c_args.push_back(nullptr);
+
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid == -1) {
+        print_error("Error starting " + os_find);
+        return false;
+    }
+    if (pid == 0) {
+        dup2(out, STDOUT_FILENO);
+        dup2(err, STDERR_FILENO);
+        execv(c_args[0], c_args.data());
+        _exit(127);
+    }
+
+    int status = 0;
+    rusage usage{};
+    if (wait4(pid, &status, 0, &usage) == -1) {
+        print_error("Error waiting for " + os_find);
+        return false;
+    }
+    result.wall_ms = now_ms() - start;
+    result.user_ms = to_ms(usage.ru_utime);
+    result.sys_ms = to_ms(usage.ru_stime);
+    result.max_rss_kb = usage.ru_maxrss;
+    result.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    result.results = count_lines(out);
+    result.syscalls = count_syscalls(read_fd(err));
+    close(out);
+    close(err);
+    return true;
+}
+
+string self_directory() {
+    char buf[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+    if (length <= 0) {
+        return ".";
+    }
+    string path(buf, static_cast<size_t>(length));
+    return path.substr(0, path.rfind('/'));
+}
+
+bool is_empty_directory(string const& path) {
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return false;
+    }
+    int entries = 0;
+    while (readdir(dir) != nullptr) {
+        entries++;
+    }
+    closedir(dir);
+    return entries == 2;
+}
+
+// Generates the tree unless the directory already holds one with the same parameters
+bool prepare_tree(string const& root, TreeParams const& params) {
+    string marker_path = root + "/" + MARKER_NAME;
+    string description = describe(params);
+
+    std::ifstream marker(marker_path);
+    if (marker) {
+        string existing;
+        std::getline(marker, existing);
+        if (existing == description) {
+            return true;
+        }
+        cerr << root << " holds a tree generated with different parameters: " << existing << endl;
+        return false;
+    }
+
+    if (mkdir(root.c_str(), 0755) == -1 && errno != EEXIST) {
+        print_error("Error creating " + root);
+        return false;
+    }
+    if (!is_empty_directory(root)) {
+        cerr << root << " is not empty and is not a benchmark tree" << endl;
+        return false;
+    }
+
+    TreeSummary summary;
+    double start = now_ms();
+    if (!generate_tree(root, params, summary)) {
+        return false;
+    }
+    cerr << "Generated " << summary.directories << " directories, " << summary.files << " files, "
+         << summary.hardlinks << " hardlinks in " << std::fixed << std::setprecision(0)
+         << now_ms() - start << " ms" << endl;
+
+    std::ofstream(marker_path) << description << endl;
+    return true;
+}
+
+void usage() {
+    cerr << "Usage: os_find_bench [OPTIONS] DIRECTORY" << endl
+         << "Generates a synthetic tree in DIRECTORY (or reuses one generated with the same options)" << endl
+         << "and runs the standard query scenarios against it." << endl
+         << "Options:" << endl
+         << "  -os-find PATH    os_find binary to measure (next to os_find_bench by default)" << endl
+         << "  -runs N          runs per scenario, the median is reported (5)" << endl
+         << "  -cold            drop page, dentry and inode caches before every run (needs root)" << endl
+         << "  -json            print one JSON object per scenario" << endl;
+    print_tree_options_usage();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    TreeParams params;
+    string root;
+    string os_find = self_directory() + "/os_find";
+    int runs = 5;
+    bool cold = false;
+    bool json = false;
+
+    for (int i = 1; i < argc;) {
+        int used = parse_tree_option(argc, argv, i, params);
+        if (used == -1) {
+            return 1;
+        }
+        if (used > 0) {
+            i += used;
+            continue;
+        }
+
+        auto option = string(argv[i]);
+        if (option == "-cold") {
+            cold = true;
+            i++;
+        } else if (option == "-json") {
+            json = true;
+            i++;
+        } else if ((option == "-os-find" || option == "-runs") && i + 1 < argc) {
+            if (option == "-os-find") {
+                os_find = argv[i + 1];
+            } else {
+                runs = std::max(1, std::atoi(argv[i + 1]));
+            }
+            i += 2;
+        } else if (option[0] != '-' && root.empty()) {
+            root = option;
+            i++;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (root.empty()) {
+        usage();
+        return 1;
+    }
+    if (!prepare_tree(root, params)) {
+        return 1;
+    }
+
+    const std::vector<Scenario> scenarios = {
+        {"no-filter", {root}},
+        {"name-hit", {root, "-name", NEEDLE_NAME}},
+        {"name-miss", {root, "-name", "os_find_no_such_name"}},
+        {"size", {root, "-size", "+65536"}},
+        {"nlinks", {root, "-nlinks", "2"}},
+        {"exec", {root, "-name", NEEDLE_NAME, "-exec", "/bin/true"}},
+    };
+
+    if (!json) {
+        cout << std::left << std::setw(12) << "scenario" << std::right
+             << std::setw(12) << "wall ms" << std::setw(12) << "min ms"
+             << std::setw(10) << "user ms" << std::setw(10) << "sys ms"
+             << std::setw(12) << "syscalls" << std::setw(12) << "rss KiB"
+             << std::setw(12) << "results" << endl;
+    }
+
+    bool failed = false;
+    for (auto const& scenario : scenarios) {
+        std::vector<string> args = scenario.args;
+        args.emplace_back("--stats-json");
+
+        std::vector<RunResult> results;
+        for (int run_index = 0; run_index < runs; run_index++) {
+            if (cold) {
+                drop_caches();
+            }
+            RunResult result{};
+            if (!run(os_find, args, result)) {
+                return 1;
+            }
+            if (result.exit_code != 0) {
+                cerr << "Scenario " << scenario.name << " exited with " << result.exit_code << endl;
+                failed = true;
+            }
+            results.push_back(result);
+        }
+        std::sort(results.begin(), results.end(), [](RunResult const& a, RunResult const& b) {
+            return a.wall_ms < b.wall_ms;
+        });
+        RunResult const& median = results[results.size() / 2];
+
+        cout << std::fixed << std::setprecision(2);
+        if (json) {
+            cout << "{\"scenario\":\"" << scenario.name << "\""
+                 << ",\"runs\":" << runs
+                 << ",\"wall_ms\":" << median.wall_ms
+                 << ",\"min_wall_ms\":" << results.front().wall_ms
+                 << ",\"user_ms\":" << median.user_ms
+                 << ",\"sys_ms\":" << median.sys_ms
+                 << ",\"syscalls\":" << median.syscalls
+                 << ",\"max_rss_kb\":" << median.max_rss_kb
+                 << ",\"results\":" << median.results << "}" << endl;
+        } else {
+            cout << std::left << std::setw(12) << scenario.name << std::right
+                 << std::setw(12) << median.wall_ms << std::setw(12) << results.front().wall_ms
+                 << std::setw(10) << median.user_ms << std::setw(10) << median.sys_ms
+                 << std::setw(12) << median.syscalls << std::setw(12) << median.max_rss_kb
+                 << std::setw(12) << median.results << endl;
+        }
+    }
+    return failed ? 1 : 0;
+}
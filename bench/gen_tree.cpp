@@ -0,0 +1,56 @@
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "tree_generator.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+
+int main(int argc, char* argv[]) {
+    TreeParams params;
+    string root;
+
+    for (int i = 1; i < argc;) {
+        int used = parse_tree_option(argc, argv, i, params);
+        if (used == -1) {
+            return 1;
+        }
+        if (used > 0) {
+            i += used;
+        } else if (argv[i][0] == '-' || !root.empty()) {
+            cerr << "Usage: os_find_gen_tree [OPTIONS] DIRECTORY" << endl;
+            print_tree_options_usage();
+            return 1;
+        } else {
+            root = argv[i++];
+        }
+    }
+    if (root.empty()) {
+        cerr << "Usage: os_find_gen_tree [OPTIONS] DIRECTORY" << endl;
+        print_tree_options_usage();
+        return 1;
+    }
+
+    if (mkdir(root.c_str(), 0755) == -1 && errno != EEXIST) {
+        cerr << "Error creating " << root << endl;
+        cerr << strerror(errno) << endl;
+        return 1;
+    }
+
+    TreeSummary summary;
+    if (!generate_tree(root, params, summary)) {
+        return 1;
+    }
+    cout << describe(params) << endl
+         << summary.directories << " directories, "
+         << summary.files << " files, "
+         << summary.hardlinks << " hardlinks, "
+         << summary.needles << " needles, "
+         << summary.bytes << " bytes" << endl;
+    return 0;
+}
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Creates (if needed) and mounts a benchmark file system.
+# Usage: mount_image.sh tmpfs MOUNT_POINT SIZE_MB
+#        mount_image.sh ext4 MOUNT_POINT SIZE_MB IMAGE_FILE
+# Needs root. Unmount with umount MOUNT_POINT.
+set -e
+
+if [ $# -lt 3 ]; then
+    sed -n '2,5p' "$0"
+    exit 1
+fi
+
+kind=$1
+mount_point=$2
+size_mb=$3
+mkdir -p "$mount_point"
+
+case "$kind" in
+    tmpfs)
+        mount -t tmpfs -o size="${size_mb}m" os_find_bench "$mount_point"
+        ;;
+    ext4)
+        image=$4
+        if [ -z "$image" ]; then
+            echo "ext4 needs an image file" >&2
+            exit 1
+        fi
+        if [ ! -f "$image" ]; then
+            truncate -s "${size_mb}M" "$image"
+            mkfs.ext4 -q -F "$image"
+        fi
+        mount -o loop "$image" "$mount_point"
+        ;;
+    *)
+        echo "Unknown file system kind: $kind" >&2
+        exit 1
+        ;;
+esac
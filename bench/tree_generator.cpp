@@ -0,0 +1,269 @@
+#include "tree_generator.h"
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+namespace {
+
+// splitmix64: tiny, fast and identical on every platform,
+// unlike the distributions of <random>
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // uniform in [low, high]
+    uint64_t range(uint64_t low, uint64_t high) {
+        return low + next() % (high - low + 1);
+    }
+
+    // uniform in [0, 1)
+    double fraction() {
+        return static_cast<double>(next() >> 11) / static_cast<double>(1ull << 53);
+    }
+
+private:
+    uint64_t state;
+};
+
+const char NAME_CHARS[] = "abcdefghijklmnopqrstuvwxyz0123456789_";
+
+void print_error(string const& what, string const& path) {
+    cerr << "Error " << what << " " << path << endl;
+    cerr << strerror(errno) << endl;
+}
+
+class Generator {
+public:
+    Generator(TreeParams const& params, TreeSummary& summary)
+        : params(params), summary(summary), random(params.seed) {}
+
+    bool directory(string const& path, int level) {
+        summary.directories++;
+        if (params.needle_every > 0 && summary.directories % params.needle_every == 0) {
+            if (!file(path + NEEDLE_NAME)) {
+                return false;
+            }
+            summary.needles++;
+        }
+
+        for (int i = 0; i < params.files_per_dir; i++) {
+            string file_path = path + name(i);
+            if (!files.empty() && random.fraction() < params.hardlink_ratio) {
+                string const& target = files[random.range(0, files.size() - 1)];
+                if (link(target.c_str(), file_path.c_str()) == -1) {
+                    print_error("linking", file_path);
+                    return false;
+                }
+                summary.hardlinks++;
+            } else {
+                if (!file(file_path)) {
+                    return false;
+                }
+                files.push_back(file_path);
+            }
+        }
+
+        if (level == params.depth) {
+            return true;
+        }
+        for (int i = 0; i < params.fanout; i++) {
+            string dir_path = path + "d" + std::to_string(i);
+            if (mkdir(dir_path.c_str(), 0755) == -1) {
+                print_error("creating", dir_path);
+                return false;
+            }
+            if (!directory(dir_path + "/", level + 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    // the index prefix keeps names unique inside a directory
+    string name(int index) {
+        string result = "f" + std::to_string(index) + "_";
+        auto length = static_cast<size_t>(random.range(params.name_min, params.name_max));
+        while (result.size() < length) {
+            result += NAME_CHARS[random.next() % (sizeof(NAME_CHARS) - 1)];
+        }
+        return result;
+    }
+
+    uint64_t size() {
+        if (params.size_max <= params.size_min) {
+            return params.size_min;
+        }
+        double low = std::log(static_cast<double>(params.size_min) + 1);
+        double high = std::log(static_cast<double>(params.size_max) + 1);
+        return static_cast<uint64_t>(std::exp(low + (high - low) * random.fraction())) - 1;
+    }
+
+    bool file(string const& path) {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            print_error("creating", path);
+            return false;
+        }
+        uint64_t file_size = size();
+        bool ok = params.fill ? fill(fd, file_size) : ftruncate(fd, static_cast<off_t>(file_size)) == 0;
+        if (!ok) {
+            print_error("writing", path);
+        }
+        close(fd);
+        summary.files++;
+        summary.bytes += file_size;
+        return ok;
+    }
+
+    bool fill(int fd, uint64_t file_size) {
+        buffer.resize(64 * 1024);
+        while (file_size > 0) {
+            size_t chunk = file_size < buffer.size() ? static_cast<size_t>(file_size) : buffer.size();
+            for (size_t i = 0; i < chunk; i += sizeof(uint64_t)) {
+                uint64_t value = random.next();
+                memcpy(buffer.data() + i, &value, std::min(sizeof(value), chunk - i));
+            }
+            ssize_t written = write(fd, buffer.data(), chunk);
+            if (written <= 0) {
+                return false;
+            }
+            file_size -= static_cast<uint64_t>(written);
+        }
+        return true;
+    }
+
+    TreeParams const& params;
+    TreeSummary& summary;
+    Random random;
+    std::vector<string> files;
+    std::vector<char> buffer;
+};
+
+template <typename T>
+bool parse_number(char const* value, T& target) {
+    try {
+        size_t used = 0;
+        double parsed = std::stod(value, &used);
+        if (used != strlen(value) || parsed < 0) {
+            return false;
+        }
+        target = static_cast<T>(parsed);
+        return true;
+    } catch (std::logic_error& error) {
+        return false;
+    }
+}
+
+} // namespace
+
+bool generate_tree(string const& root, TreeParams const& params, TreeSummary& summary) {
+    if (params.name_min < 1 || params.name_max < params.name_min) {
+        cerr << "Bad name length range" << endl;
+        return false;
+    }
+    string path = root;
+    if (path.back() != '/') { path += '/'; }
+
+    Generator generator(params, summary);
+    return generator.directory(path, 0);
+}
+
+int parse_tree_option(int argc, char* argv[], int i, TreeParams& params) {
+    string option = argv[i];
+    if (option == "-fill") {
+        params.fill = true;
+        return 1;
+    }
+
+    static const char* const WITH_VALUE[] = {"-seed", "-fanout", "-depth", "-files", "-name-min", "-name-max",
+                                             "-hardlinks", "-size-min", "-size-max", "-needle-every"};
+    bool known = false;
+    for (auto name : WITH_VALUE) {
+        known = known || option == name;
+    }
+    if (!known) {
+        return 0;
+    }
+    if (argc < i + 2) {
+        cerr << "Option " << option << " is missing its value" << endl;
+        return -1;
+    }
+
+    char const* value = argv[i + 1];
+    bool ok;
+    if (option == "-seed") {
+        ok = parse_number(value, params.seed);
+    } else if (option == "-fanout") {
+        ok = parse_number(value, params.fanout);
+    } else if (option == "-depth") {
+        ok = parse_number(value, params.depth);
+    } else if (option == "-files") {
+        ok = parse_number(value, params.files_per_dir);
+    } else if (option == "-name-min") {
+        ok = parse_number(value, params.name_min);
+    } else if (option == "-name-max") {
+        ok = parse_number(value, params.name_max);
+    } else if (option == "-hardlinks") {
+        ok = parse_number(value, params.hardlink_ratio) && params.hardlink_ratio <= 1;
+    } else if (option == "-size-min") {
+        ok = parse_number(value, params.size_min);
+    } else if (option == "-size-max") {
+        ok = parse_number(value, params.size_max);
+    } else {
+        ok = parse_number(value, params.needle_every);
+    }
+    if (!ok) {
+        cerr << "Bad " << option << " argument" << endl;
+        return -1;
+    }
+    return 2;
+}
+
+string describe(TreeParams const& params) {
+    std::ostringstream out;
+    out << "seed=" << params.seed
+        << " fanout=" << params.fanout
+        << " depth=" << params.depth
+        << " files=" << params.files_per_dir
+        << " name=" << params.name_min << ".." << params.name_max
+        << " hardlinks=" << params.hardlink_ratio
+        << " size=" << params.size_min << ".." << params.size_max
+        << " fill=" << params.fill
+        << " needle_every=" << params.needle_every;
+    return out.str();
+}
+
+void print_tree_options_usage() {
+    cerr << "Tree options:" << endl
+         << "  -seed N          seed of the generator (1)" << endl
+         << "  -fanout N        subdirectories per directory (8)" << endl
+         << "  -depth N         levels of subdirectories (4)" << endl
+         << "  -files N         files per directory (32)" << endl
+         << "  -name-min N      shortest file name (8)" << endl
+         << "  -name-max N      longest file name (24)" << endl
+         << "  -hardlinks R     fraction of files that are hardlinks (0.05)" << endl
+         << "  -size-min N      smallest file size in bytes (0)" << endl
+         << "  -size-max N      largest file size in bytes, log-uniform (1048576)" << endl
+         << "  -fill            write contents instead of creating sparse files" << endl
+         << "  -needle-every N  put a file named " << NEEDLE_NAME << " in every n-th directory (16)" << endl;
+}
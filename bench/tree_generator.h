@@ -0,0 +1,46 @@
+#ifndef OS_FIND_TREE_GENERATOR_H
+#define OS_FIND_TREE_GENERATOR_H
+
+#include <cstdint>
+#include <string>
+
+// Parameters of a synthetic directory tree.
+// The same parameters and seed always produce the same tree.
+struct TreeParams {
+    uint64_t seed = 1;
+    int fanout = 8;              // subdirectories per directory
+    int depth = 4;               // levels of subdirectories below the root
+    int files_per_dir = 32;
+    int name_min = 8;            // file name length is uniform in [name_min, name_max]
+    int name_max = 24;
+    double hardlink_ratio = 0.05; // fraction of files that are extra links to earlier files
+    uint64_t size_min = 0;       // file size is log-uniform in [size_min, size_max]
+    uint64_t size_max = 1 << 20;
+    bool fill = false;           // write pseudo-random contents instead of sparse files
+    int needle_every = 16;       // every n-th directory gets a file named NEEDLE_NAME
+};
+
+const char* const NEEDLE_NAME = "os_find_needle";
+
+struct TreeSummary {
+    uint64_t directories = 0;
+    uint64_t files = 0;
+    uint64_t hardlinks = 0;
+    uint64_t needles = 0;
+    uint64_t bytes = 0;
+};
+
+// Generates the tree into an existing empty directory.
+// Returns false and prints the reason to stderr on failure.
+bool generate_tree(std::string const& root, TreeParams const& params, TreeSummary& summary);
+
+// Parses a generator option at argv[i]. Returns the number of consumed
+// arguments, 0 if the option is not a generator option and -1 on a bad value.
+int parse_tree_option(int argc, char* argv[], int i, TreeParams& params);
+
+// Human readable one-line description of the parameters, used as a tree marker.
+std::string describe(TreeParams const& params);
+
+void print_tree_options_usage();
+
+#endif //OS_FIND_TREE_GENERATOR_H
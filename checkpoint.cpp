@@ -0,0 +1,114 @@
+#include "checkpoint.h"
+
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+
+#include "mapped_file.h"
+#include "output.h"
+#include "progress.h"
+#include "stats.h"
+
+std::string checkpoint_path;
+
+namespace {
+
+const char CHECKPOINT_MAGIC[8] = {'O', 'S', 'F', 'C', 'K', 'P', 'T', 'S'};
+const uint32_t CHECKPOINT_VERSION = 1;
+const uint64_t CHECKPOINT_INTERVAL_NS = 5000000000u;
+// the clock is only read every this many entries
+const unsigned CLOCK_CHECK_ENTRIES = 256;
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t results;
+    uint64_t output_bytes;
+    uint64_t root_offset;
+    uint64_t root_length;
+    uint64_t entry_offset;  // entry path relative to the root
+    uint64_t entry_length;
+    uint64_t file_size;
+};
+
+std::string checkpoint_root;
+uint64_t next_checkpoint_ns;
+unsigned entries_to_clock_check = CLOCK_CHECK_ENTRIES;
+
+void save(std::string const& entry) {
+    // the output must hold every result before the entry
+    flush_output();
+
+    CheckpointHeader header{};
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version = CHECKPOINT_VERSION;
+    header.results = counter_total(&TraversalCounters::matches);
+    header.output_bytes = output_bytes();
+    header.root_length = checkpoint_root.size();
+    header.entry_length = entry.size();
+
+    SectionWriter writer;
+    if (!writer.open(checkpoint_path)) {
+        return;
+    }
+    writer.section(&header, sizeof(header));
+    header.root_offset = writer.section(checkpoint_root.data(), checkpoint_root.size());
+    header.entry_offset = writer.section(entry.data(), entry.size());
+    header.file_size = writer.size();
+    writer.commit(&header, sizeof(header));
+}
+
+} // namespace
+
+bool read_checkpoint(std::string const& path, Checkpoint& checkpoint) {
+    MappedFile file;
+    if (!file.open(path)) {
+        return false;
+    }
+    auto header = reinterpret_cast<CheckpointHeader const*>(file.data());
+    if (file.size() < sizeof(CheckpointHeader) ||
+        memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 ||
+        header->version != CHECKPOINT_VERSION || header->file_size != file.size()) {
+        std::cerr << path << " is not an os_find checkpoint of version " << CHECKPOINT_VERSION << std::endl;
+        return false;
+    }
+    checkpoint.root.assign(file.data() + header->root_offset, header->root_length);
+    checkpoint.results = header->results;
+    checkpoint.output_bytes = header->output_bytes;
+
+    std::string entry(file.data() + header->entry_offset, header->entry_length);
+    checkpoint.entry.clear();
+    size_t start = 0;
+    while (start < entry.size()) {
+        size_t end = entry.find('/', start);
+        if (end == std::string::npos) {
+            end = entry.size();
+        }
+        checkpoint.entry.push_back(entry.substr(start, end - start));
+        start = end + 1;
+    }
+    return true;
+}
+
+void start_checkpoints(std::string const& root) {
+    checkpoint_root = root;
+    next_checkpoint_ns = now_ns() + CHECKPOINT_INTERVAL_NS;
+}
+
+void entry_done(std::string const& dir_path, const char* name) {
+    if (--entries_to_clock_check != 0) {
+        return;
+    }
+    entries_to_clock_check = CLOCK_CHECK_ENTRIES;
+    uint64_t now = now_ns();
+    if (now < next_checkpoint_ns) {
+        return;
+    }
+    save(dir_path.substr(checkpoint_root.size()) + name);
+    next_checkpoint_ns = now + CHECKPOINT_INTERVAL_NS;
+}
+
+void finish_checkpoints() {
+    unlink(checkpoint_path.c_str());
+}
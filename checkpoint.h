@@ -0,0 +1,40 @@
+#ifndef OS_FIND_CHECKPOINT_H
+#define OS_FIND_CHECKPOINT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// File the traversal state is saved to every few seconds, empty without -checkpoint.
+// The state is the path of the last entry that was handled completely: as directories are
+// read in getdents64 order, everything before it in that order is done, and the directories
+// on its path are the frontier of the traversal.
+extern std::string checkpoint_path;
+
+inline bool checkpoint_enabled() {
+    return !checkpoint_path.empty();
+}
+
+struct Checkpoint {
+    std::string root;
+    // names of the directories leading to the last handled entry, and its name
+    std::vector<std::string> entry;
+    uint64_t results;
+    // output written before the checkpoint; anything after it is dropped by a resume
+    uint64_t output_bytes;
+};
+
+// Prints the reason to stderr on failure
+bool read_checkpoint(std::string const& path, Checkpoint& checkpoint);
+
+// Starts the checkpoint clock for a traversal of root (ending with '/')
+void start_checkpoints(std::string const& root);
+
+// Called once an entry is handled, a directory after all of its contents.
+// Flushes the output and saves the checkpoint when one is due.
+void entry_done(std::string const& dir_path, const char* name);
+
+// The traversal completed, the checkpoint is removed
+void finish_checkpoints();
+
+#endif //OS_FIND_CHECKPOINT_H
@@ -0,0 +1,194 @@
+#include "checksum.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "fd.h"
+#include "hash.h"
+#include "output.h"
+#include "parallel.h"
+
+HashAlgorithm hash_algorithm = HashAlgorithm::NONE;
+
+namespace {
+
+// enough files to keep the pool busy, few enough to start output early
+const size_t BATCH_SIZE = 4096;
+const size_t READ_BUFFER_SIZE = 1 << 20;
+const size_t READ_BUFFER_ALIGNMENT = 4096;
+
+struct HashTarget {
+    std::string path;
+    // empty if the file could not be read
+    std::string digest;
+};
+
+std::vector<HashTarget> batch;
+
+// Page aligned, so that the kernel copies whole pages of the page cache
+class ReadBuffer {
+public:
+    ReadBuffer() {
+        if (posix_memalign(&memory, READ_BUFFER_ALIGNMENT, READ_BUFFER_SIZE) != 0) {
+            memory = nullptr;
+        }
+    }
+    ReadBuffer(ReadBuffer const&) = delete;
+    ReadBuffer& operator=(ReadBuffer const&) = delete;
+    ~ReadBuffer() {
+        free(memory);
+    }
+
+    char* data() const { return static_cast<char*>(memory); }
+
+private:
+    void* memory = nullptr;
+};
+
+// Feeds the rest of the file to the hash. Returns false if reading failed, with errno set.
+template<typename Hash>
+bool hash_file(int fd, char* buf, Hash& hash) {
+    while (true) {
+        ssize_t read_size = read(fd, buf, READ_BUFFER_SIZE);
+        if (read_size == -1 && errno == EINTR) {
+            continue;
+        }
+        if (read_size == -1) {
+            return false;
+        }
+        if (read_size == 0) {
+            return true;
+        }
+        hash.update(buf, static_cast<size_t>(read_size));
+    }
+}
+
+std::string to_hex(const unsigned char* bytes, size_t size) {
+    static const char DIGITS[] = "0123456789abcdef";
+    std::string hex(2 * size, '0');
+    for (size_t i = 0; i < size; i++) {
+        hex[2 * i] = DIGITS[bytes[i] >> 4];
+        hex[2 * i + 1] = DIGITS[bytes[i] & 0xf];
+    }
+    return hex;
+}
+
+template<typename Sha>
+bool sha_digest(int fd, char* buf, std::string& digest) {
+    Sha hash;
+    if (!hash_file(fd, buf, hash)) {
+        return false;
+    }
+    unsigned char bytes[Sha::DIGEST_SIZE];
+    hash.finish(bytes);
+    digest = to_hex(bytes, sizeof(bytes));
+    return true;
+}
+
+bool xxh64_digest(int fd, char* buf, std::string& digest) {
+    Xxh64 hash;
+    if (!hash_file(fd, buf, hash)) {
+        return false;
+    }
+    // big-endian, as xxhsum prints it
+    uint64_t value = hash.digest();
+    unsigned char bytes[sizeof(value)];
+    for (size_t i = 0; i < sizeof(value); i++) {
+        bytes[i] = static_cast<unsigned char>(value >> (56 - 8 * i));
+    }
+    digest = to_hex(bytes, sizeof(bytes));
+    return true;
+}
+
+void hash_target(HashTarget& target) {
+    static thread_local ReadBuffer buf;
+    FileDescriptor fd = open_contents(target.path.c_str());
+    bool hashed = false;
+    if (fd.valid() && buf.data() != nullptr) {
+        posix_fadvise(fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+        switch (hash_algorithm) {
+            case HashAlgorithm::SHA1:
+                hashed = sha_digest<Sha1>(fd.get(), buf.data(), target.digest);
+                break;
+            case HashAlgorithm::SHA256:
+                hashed = sha_digest<Sha256>(fd.get(), buf.data(), target.digest);
+                break;
+            default:
+                hashed = xxh64_digest(fd.get(), buf.data(), target.digest);
+                break;
+        }
+    }
+    if (!hashed) {
+        int saved_errno = errno;
+        std::cerr << "Error reading " << target.path << std::endl;
+        std::cerr << strerror(saved_errno) << std::endl;
+    }
+}
+
+// Like sha1sum, a line whose path has a backslash or a line break starts with a backslash
+// and has them escaped. -print0 ends the lines with NUL instead and escapes nothing.
+void emit_line(HashTarget const& target) {
+    std::string line;
+    bool escaped = output_format == OutputFormat::LINES &&
+                   target.path.find_first_of("\\\n\r") != std::string::npos;
+    if (escaped) {
+        line += '\\';
+    }
+    line += target.digest;
+    line += "  ";
+    if (escaped) {
+        for (char c : target.path) {
+            switch (c) {
+                case '\\': line += "\\\\"; break;
+                case '\n': line += "\\n"; break;
+                case '\r': line += "\\r"; break;
+                default: line += c; break;
+            }
+        }
+    } else {
+        line += target.path;
+    }
+    line += output_format == OutputFormat::PRINT0 ? '\0' : '\n';
+    emit_text(line);
+}
+
+void hash_batch() {
+    parallel_for(batch.size(), [](size_t i) { hash_target(batch[i]); });
+    for (auto const& target : batch) {
+        if (!target.digest.empty()) {
+            emit_line(target);
+        }
+    }
+    batch.clear();
+}
+
+} // namespace
+
+bool parse_hash_algorithm(std::string const& name) {
+    if (name == "sha1") {
+        hash_algorithm = HashAlgorithm::SHA1;
+    } else if (name == "sha256") {
+        hash_algorithm = HashAlgorithm::SHA256;
+    } else if (name == "xxh64") {
+        hash_algorithm = HashAlgorithm::XXH64;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void add_hash_target(std::string const& dir_path, const char* name, EntryInfo const&) {
+    batch.push_back(HashTarget{dir_path + name, {}});
+    if (batch.size() >= BATCH_SIZE) {
+        hash_batch();
+    }
+}
+
+void finish_hashes() {
+    hash_batch();
+}
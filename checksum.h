@@ -0,0 +1,34 @@
+#ifndef OS_FIND_CHECKSUM_H
+#define OS_FIND_CHECKSUM_H
+
+#include <string>
+
+#include "entry.h"
+
+enum class HashAlgorithm {
+    NONE,
+    SHA1,
+    SHA256,
+    XXH64
+};
+
+// -hash: instead of the matches, output a line with the digest of the contents and
+// the path of every matched file, in the format of sha1sum
+extern HashAlgorithm hash_algorithm;
+
+inline bool hashing() {
+    return hash_algorithm != HashAlgorithm::NONE;
+}
+
+// Parses sha1, sha256 or xxh64
+bool parse_hash_algorithm(std::string const& name);
+
+// Takes a matched file. Not thread-safe, the caller serializes the calls.
+// Files are read and hashed in batches by a pool of threads, and the lines of a batch
+// are output in the order its files were taken.
+void add_hash_target(std::string const& dir_path, const char* name, EntryInfo const& info);
+
+// Hashes the files of the last batch
+void finish_hashes();
+
+#endif //OS_FIND_CHECKSUM_H
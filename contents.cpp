@@ -0,0 +1,113 @@
+#include "contents.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "fd.h"
+#include "parallel.h"
+
+std::string contents_target;
+
+namespace {
+
+const size_t BATCH_SIZE = 4096;
+const size_t READ_BUFFER_SIZE = 1 << 20;
+
+struct Candidate {
+    std::string dir_path;
+    std::string name;
+    EntryInfo info;
+    bool found;
+};
+
+std::mutex batch_mutex;
+std::vector<Candidate> batch;
+
+// Reads the file until the string shows up. The last bytes of a read are kept in front
+// of the next one, so that an occurrence split between two reads is found too.
+// Returns false if reading failed, with errno set.
+bool search_file(int fd, bool& found) {
+    static thread_local std::vector<char> buf;
+    size_t needle = contents_target.size();
+    buf.resize(std::max(READ_BUFFER_SIZE, 2 * needle));
+    size_t kept = 0;
+    found = false;
+    while (true) {
+        ssize_t read_size = read(fd, buf.data() + kept, buf.size() - kept);
+        if (read_size == -1 && errno == EINTR) {
+            continue;
+        }
+        if (read_size == -1) {
+            return false;
+        }
+        if (read_size == 0) {
+            return true;
+        }
+        size_t size = kept + static_cast<size_t>(read_size);
+        // glibc scans with SSE2 for the first byte and the two-way algorithm for the rest
+        if (memmem(buf.data(), size, contents_target.data(), needle) != nullptr) {
+            found = true;
+            return true;
+        }
+        kept = std::min(size, needle - 1);
+        memmove(buf.data(), buf.data() + size - kept, kept);
+    }
+}
+
+void check_candidate(Candidate& candidate) {
+    std::string path = candidate.dir_path + candidate.name;
+    FileDescriptor fd = open_contents(path.c_str());
+    if (fd.valid()) {
+        posix_fadvise(fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    if (!fd.valid() || !search_file(fd.get(), candidate.found)) {
+        int saved_errno = errno;
+        std::cerr << "Error reading " << path << std::endl;
+        std::cerr << strerror(saved_errno) << std::endl;
+        candidate.found = false;
+    }
+}
+
+void check_batch(std::vector<Candidate>& checked, MatchCallback on_match) {
+    parallel_for(checked.size(), [&checked](size_t i) { check_candidate(checked[i]); });
+    for (auto const& candidate : checked) {
+        if (candidate.found) {
+            on_match(candidate.dir_path, candidate.name.c_str(), candidate.info);
+        }
+    }
+}
+
+} // namespace
+
+void add_contents_candidate(std::string const& dir_path, const char* name, EntryInfo const& info,
+                            MatchCallback on_match) {
+    // a file shorter than the string can not have it
+    if ((info.stats_mask & STATX_SIZE) != 0 && static_cast<uint64_t>(info.stats.st_size) < contents_target.size()) {
+        return;
+    }
+    std::vector<Candidate> full;
+    {
+        std::lock_guard<std::mutex> guard(batch_mutex);
+        batch.push_back(Candidate{dir_path, name, info, false});
+        if (batch.size() < BATCH_SIZE) {
+            return;
+        }
+        full.swap(batch);
+    }
+    check_batch(full, on_match);
+}
+
+void finish_contents(MatchCallback on_match) {
+    std::vector<Candidate> last;
+    {
+        std::lock_guard<std::mutex> guard(batch_mutex);
+        last.swap(batch);
+    }
+    check_batch(last, on_match);
+}
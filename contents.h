@@ -0,0 +1,29 @@
+#ifndef OS_FIND_CONTENTS_H
+#define OS_FIND_CONTENTS_H
+
+#include <string>
+
+#include "entry.h"
+#include "index.h"
+
+// -contains: a file only matches if its contents have this string, empty if not used.
+// It is the most expensive predicate, so it is checked last, on the files that passed
+// all the others.
+extern std::string contents_target;
+
+inline bool contents_enabled() {
+    return !contents_target.empty();
+}
+
+// Takes a file that passed the other predicates. Thread-safe: files are only queued under
+// a lock, and the thread that fills a batch reads it outside of it while the others go on
+// walking. Files are read by a pool of threads, so that the reads of many small files
+// overlap, and each one only until the first occurrence. The files of a batch that
+// contain the string are passed to on_match in the order they were taken, with no lock held.
+void add_contents_candidate(std::string const& dir_path, const char* name, EntryInfo const& info,
+                            MatchCallback on_match);
+
+// Checks the files of the last batch
+void finish_contents(MatchCallback on_match);
+
+#endif //OS_FIND_CONTENTS_H
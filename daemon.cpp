@@ -0,0 +1,410 @@
+#include "daemon.h"
+
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+#include "directory.h"
+#include "fd.h"
+#include "output.h"
+#include "predicates.h"
+#include "progress.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+namespace {
+
+const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                            IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_ONLYDIR | IN_DONT_FOLLOW;
+const size_t EVENT_BUFFER_SIZE = 64 * 1024;
+const size_t MAX_QUERY_SIZE = 64 * 1024;
+// a client that stops reading must not stall the updates for long
+const time_t CLIENT_TIMEOUT_SECONDS = 10;
+
+bool fill_address(string const& socket_path, sockaddr_un& address) {
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        cerr << "Socket path is too long: " << socket_path << endl;
+        return false;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return true;
+}
+
+struct WatchedDirectory {
+    int watch = -1;
+    std::unordered_map<string, EntryInfo> entries;
+};
+
+class TreeModel {
+public:
+    explicit TreeModel(string root) : root(std::move(root)) {}
+
+    bool start() {
+        inotify_fd.reset(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+        if (!inotify_fd.valid()) {
+            cerr << "Error initializing inotify" << endl;
+            print_error();
+            return false;
+        }
+        scan(root);
+        return directories.count(root) != 0;
+    }
+
+    int events_fd() const { return inotify_fd.get(); }
+
+    size_t directory_count() const { return directories.size(); }
+
+    // Applies all queued events. Several events about one entry cost a single stat.
+    void update() {
+        alignas(inotify_event) char buf[EVENT_BUFFER_SIZE];
+        std::set<std::pair<string, string>> changed;
+        bool overflow = false;
+        while (true) {
+            ssize_t read_size = read(inotify_fd.get(), buf, sizeof(buf));
+            if (read_size <= 0) {
+                break;
+            }
+            for (char* ptr = buf; ptr < buf + read_size;) {
+                auto event = reinterpret_cast<inotify_event*>(ptr);
+                ptr += sizeof(inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    overflow = true;
+                } else if (event->mask & IN_IGNORED) {
+                    watch_paths.erase(event->wd);
+                } else if (event->len > 0) {
+                    auto path = watch_paths.find(event->wd);
+                    if (path != watch_paths.end()) {
+                        changed.emplace(path->second, event->name);
+                    }
+                }
+            }
+        }
+
+        if (overflow) {
+            // events were lost, nothing in the model can be trusted
+            cerr << "inotify queue overflowed, rescanning " << root << endl;
+            remove_subtree(root);
+            scan(root);
+            return;
+        }
+        for (auto const& entry : changed) {
+            refresh(entry.first, entry.second);
+        }
+    }
+
+    void query(string const& prefix, MatchCallback on_match) const {
+        bool need_stats = predicates_need_stats();
+        bool exact_name = !name_target.empty() && !name_is_pattern();
+        for (auto it = directories.lower_bound(prefix);
+             it != directories.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+            auto const& entries = it->second.entries;
+            if (exact_name) {
+                // the entries are hashed by name, a plain -name is a lookup per directory
+                auto entry = entries.find(name_target);
+                if (entry != entries.end()) {
+                    check(it->first, *entry, need_stats, on_match);
+                }
+                continue;
+            }
+            for (auto const& entry : entries) {
+                check(it->first, entry, need_stats, on_match);
+            }
+        }
+    }
+
+private:
+    static void check(string const& dir_path, std::pair<const string, EntryInfo> const& entry,
+                      bool need_stats, MatchCallback on_match) {
+        EntryInfo const& info = entry.second;
+        bump(traversal_counters.entries);
+        if (!type_wanted(info.type) || !matches_dirent(info.ino, entry.first.c_str())) {
+            return;
+        }
+        if (need_stats && !matches_stats(info.stats)) {
+            return;
+        }
+        on_match(dir_path, entry.first.c_str(), info);
+    }
+
+    static bool read_info(int dir_fd, const char* name, EntryInfo& info) {
+        if (stat_entry(dir_fd, name, STATX_BASIC_STATS, &info.stats, info.stats_mask) == -1) {
+            return false;
+        }
+        info.ino = info.stats.st_ino;
+        info.type = static_cast<unsigned char>(IFTODT(info.stats.st_mode));
+        return true;
+    }
+
+    // Reads the directory at path and everything below it into the model
+    void scan(string const& path) {
+        FileDescriptor fd = open_directory(AT_FDCWD, path.c_str());
+        if (!fd.valid()) {
+            cerr << "Error reading contents of " << path << endl;
+            print_error();
+            return;
+        }
+        // watch before listing, so that no change after the listing is missed
+        int watch = inotify_add_watch(inotify_fd.get(), path.c_str(), WATCH_MASK);
+        if (watch == -1) {
+            cerr << "Error watching " << path << ", it will not be updated" << endl;
+            print_error();
+        } else {
+            watch_paths[watch] = path;
+        }
+
+        std::vector<ListedEntry> listed;
+        if (!list_directory(fd.get(), listed)) {
+            cerr << "Error reading contents of " << path << endl;
+            print_error();
+            return;
+        }
+        bump(traversal_counters.directories);
+        if (progress_enabled()) {
+            set_current_directory(path);
+        }
+
+        WatchedDirectory& directory = directories[path];
+        directory.watch = watch;
+        std::vector<string> subdirectories;
+        for (auto const& entry : listed) {
+            bump(traversal_counters.entries);
+            EntryInfo info{};
+            if (!read_info(fd.get(), entry.name.c_str(), info)) {
+                // removed since the listing, or not accessible
+                continue;
+            }
+            if (info.type == DT_DIR) {
+                subdirectories.push_back(path + entry.name + "/");
+            }
+            directory.entries.emplace(entry.name, info);
+        }
+        for (auto const& subdirectory : subdirectories) {
+            if (directories.count(subdirectory) == 0) {
+                scan(subdirectory);
+            }
+        }
+    }
+
+    // Drops the directory at path and everything below it, with their watches.
+    // A directory moved within the tree may already be scanned at its new path, and
+    // inotify gives it the same watch there, so a watch is only removed by its last owner.
+    void remove_subtree(string const& path) {
+        auto it = directories.lower_bound(path);
+        while (it != directories.end() && it->first.compare(0, path.size(), path) == 0) {
+            auto owner = watch_paths.find(it->second.watch);
+            if (owner != watch_paths.end() && owner->second == it->first) {
+                inotify_rm_watch(inotify_fd.get(), it->second.watch);
+                watch_paths.erase(owner);
+            }
+            it = directories.erase(it);
+        }
+    }
+
+    // Brings one entry of a watched directory in line with the file system
+    void refresh(string const& dir_path, string const& name) {
+        auto directory = directories.find(dir_path);
+        if (directory == directories.end()) {
+            return;
+        }
+        auto& entries = directory->second.entries;
+        auto old = entries.find(name);
+        string path = dir_path + name + "/";
+
+        EntryInfo info{};
+        if (!read_info(AT_FDCWD, (dir_path + name).c_str(), info)) {
+            if (old != entries.end()) {
+                if (old->second.type == DT_DIR) {
+                    remove_subtree(path);
+                }
+                entries.erase(old);
+            }
+            return;
+        }
+
+        if (old != entries.end() && old->second.type == DT_DIR &&
+            (info.type != DT_DIR || info.ino != old->second.ino)) {
+            // replaced by another directory or file
+            remove_subtree(path);
+        }
+        entries[name] = info;
+        if (info.type == DT_DIR && directories.count(path) == 0) {
+            scan(path);
+        }
+    }
+
+    string root;
+    FileDescriptor inotify_fd;
+    // ordered by path, so that a directory and everything below it form a range
+    std::map<string, WatchedDirectory> directories;
+    std::unordered_map<int, string> watch_paths;
+};
+
+// Reads the NUL separated arguments of a query, sent until the client shuts down writing
+bool read_query(int fd, std::vector<string>& args) {
+    string query;
+    char buf[4096];
+    while (true) {
+        ssize_t read_size = read(fd, buf, sizeof(buf));
+        if (read_size == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (read_size == 0) {
+            break;
+        }
+        query.append(buf, static_cast<size_t>(read_size));
+        if (query.size() > MAX_QUERY_SIZE) {
+            return false;
+        }
+    }
+    size_t start = 0;
+    while (start < query.size()) {
+        size_t end = query.find('\0', start);
+        if (end == string::npos) {
+            end = query.size();
+        }
+        args.push_back(query.substr(start, end - start));
+        start = end + 1;
+    }
+    return true;
+}
+
+void answer(int client_fd, TreeModel& model, QueryParser parse_query, MatchCallback on_match) {
+    timeval timeout{CLIENT_TIMEOUT_SECONDS, 0};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::vector<string> args;
+    string prefix;
+    string error;
+    if (!read_query(client_fd, args)) {
+        return;
+    }
+    if (!parse_query(args, prefix, error)) {
+        write_fully(client_fd, error.data(), error.size());
+        return;
+    }
+    // the answer reflects every change queued before the query
+    model.update();
+
+    output_fd = client_fd;
+    write_output_header();
+    model.query(prefix, on_match);
+    flush_output();
+    output_fd = STDOUT_FILENO;
+}
+
+} // namespace
+
+bool run_daemon(string const& socket_path, string const& root, QueryParser parse_query, MatchCallback on_match) {
+    sockaddr_un address{};
+    if (!fill_address(socket_path, address)) {
+        return false;
+    }
+
+    TreeModel model(root);
+    start_progress();
+    bool started = model.start();
+    stop_progress();
+    if (!started) {
+        return false;
+    }
+    cerr << "Watching " << model.directory_count() << " directories under " << root << endl;
+
+    FileDescriptor listen_fd(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    // a socket left by a previous daemon would fail bind
+    unlink(socket_path.c_str());
+    // the answers list the whole tree, so only the owner may connect: the socket is created 0600
+    mode_t old_mask = umask(0077);
+    bool bound = listen_fd.valid() &&
+                 bind(listen_fd.get(), reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    umask(old_mask);
+    if (!bound || listen(listen_fd.get(), SOMAXCONN) == -1) {
+        cerr << "Error listening on " << socket_path << endl;
+        print_error();
+        return false;
+    }
+    // a client going away mid-answer must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    pollfd polled[2] = {{model.events_fd(), POLLIN, 0}, {listen_fd.get(), POLLIN, 0}};
+    while (true) {
+        if (poll(polled, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cerr << "Error waiting for events" << endl;
+            print_error();
+            return false;
+        }
+        if (polled[0].revents & POLLIN) {
+            model.update();
+        }
+        if (polled[1].revents & POLLIN) {
+            FileDescriptor client_fd(accept4(listen_fd.get(), nullptr, nullptr, SOCK_CLOEXEC));
+            if (client_fd.valid()) {
+                answer(client_fd.get(), model, parse_query, on_match);
+            }
+        }
+    }
+}
+
+bool run_client(string const& socket_path, std::vector<string> const& args, AnswerCallback on_answer) {
+    sockaddr_un address{};
+    if (!fill_address(socket_path, address)) {
+        return false;
+    }
+    FileDescriptor fd(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if (!fd.valid() || connect(fd.get(), reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+        cerr << "Error connecting to the daemon at " << socket_path << endl;
+        print_error();
+        return false;
+    }
+
+    string query;
+    for (auto const& arg : args) {
+        query += arg;
+        query += '\0';
+    }
+    if (!write_fully(fd.get(), query.data(), query.size()) || shutdown(fd.get(), SHUT_WR) == -1) {
+        cerr << "Error sending the query to " << socket_path << endl;
+        print_error();
+        return false;
+    }
+
+    char buf[64 * 1024];
+    while (true) {
+        ssize_t read_size = read(fd.get(), buf, sizeof(buf));
+        if (read_size == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cerr << "Error reading the answer from " << socket_path << endl;
+            print_error();
+            return false;
+        }
+        if (read_size == 0) {
+            return true;
+        }
+        on_answer(buf, static_cast<size_t>(read_size));
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef OS_FIND_DAEMON_H
+#define OS_FIND_DAEMON_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "index.h"
+
+// Parses the arguments of a client query into the global options and sets prefix
+// to the directory to search in. Returns false with the message for the client in error
+// if the arguments are invalid.
+typedef bool (*QueryParser)(std::vector<std::string> const& args, std::string& prefix, std::string& error);
+
+// Receives a part of the answer of the daemon
+typedef void (*AnswerCallback)(const char* data, size_t size);
+
+// Reads the tree under root (an absolute path ending with '/') into memory, names and stats
+// of all entries, and keeps it current with inotify. Answers the queries of the clients
+// connecting to the Unix socket at socket_path by running the predicates over the model,
+// without touching the file system. Returns only if setting up failed.
+bool run_daemon(std::string const& socket_path, std::string const& root,
+                QueryParser parse_query, MatchCallback on_match);
+
+// Sends a query to the daemon listening at socket_path and passes its answer to on_answer.
+// A query is the NUL separated arguments of os_find; the answer is the output the daemon
+// formats as requested by them.
+bool run_client(std::string const& socket_path, std::vector<std::string> const& args, AnswerCallback on_answer);
+
+#endif //OS_FIND_DAEMON_H
@@ -0,0 +1,247 @@
+#include "dircache.h"
+
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+#include "fd.h"
+#include "mapped_file.h"
+
+std::string dir_cache_path;
+
+namespace {
+
+const char CACHE_MAGIC[8] = {'O', 'S', 'F', 'D', 'C', 'A', 'C', 'H'};
+const uint32_t CACHE_VERSION = 1;
+const unsigned IDENTITY_MASK = STATX_INO | STATX_MTIME | STATX_CTIME;
+// mtime of a directory changed within the timestamp granularity of this run,
+// which may still change without mtime moving; never valid
+const int64_t UNSTABLE_TIME = INT64_MIN;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t directory_count;
+    uint64_t entry_count;
+    uint64_t directories_offset;  // CachedDirectory sorted by (dev, ino)
+    uint64_t inodes_offset;
+    uint64_t types_offset;
+    uint64_t name_offsets_offset; // entry_count + 1 offsets into the names
+    uint64_t names_offset;
+    uint64_t file_size;
+};
+
+struct CachedDirectory {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime;
+    int64_t ctime;
+    uint64_t first_entry;
+    uint64_t entry_count;
+};
+
+struct StoredListing {
+    CachedDirectory directory;
+    std::vector<ListedEntry> entries;
+};
+
+MappedFile cache_file;
+CacheHeader const* header = nullptr;
+CachedDirectory const* cached_directories = nullptr;
+uint64_t const* cached_inodes = nullptr;
+uint8_t const* cached_types = nullptr;
+uint64_t const* cached_name_offsets = nullptr;
+const char* cached_names = nullptr;
+
+std::mutex stored_mutex;
+std::vector<StoredListing> stored;
+// per cached directory, whether this run found it unchanged; the others are dropped on save
+std::vector<bool> confirmed;
+size_t confirmed_count = 0;
+int64_t run_start_ns;
+
+uint64_t device_of(struct statx const& identity) {
+    return makedev(identity.stx_dev_major, identity.stx_dev_minor);
+}
+
+bool key_less(CachedDirectory const& a, CachedDirectory const& b) {
+    return a.dev < b.dev || (a.dev == b.dev && a.ino < b.ino);
+}
+
+bool same_key(CachedDirectory const& a, CachedDirectory const& b) {
+    return a.dev == b.dev && a.ino == b.ino;
+}
+
+CachedDirectory describe(struct statx const& identity) {
+    CachedDirectory directory{device_of(identity), identity.stx_ino, to_ns(identity.stx_mtime),
+                              to_ns(identity.stx_ctime), 0, 0};
+    if (directory.mtime >= run_start_ns - 1000000000 || directory.ctime >= run_start_ns - 1000000000) {
+        directory.mtime = UNSTABLE_TIME;
+    }
+    return directory;
+}
+
+} // namespace
+
+bool load_dir_cache() {
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    run_start_ns = to_ns(now);
+
+    if (access(dir_cache_path.c_str(), F_OK) == -1 && errno == ENOENT) {
+        return true;
+    }
+    if (!cache_file.open(dir_cache_path)) {
+        return false;
+    }
+    const char* mapping = cache_file.data();
+    auto loaded = reinterpret_cast<CacheHeader const*>(mapping);
+    if (cache_file.size() < sizeof(CacheHeader) ||
+        memcmp(loaded->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        loaded->version != CACHE_VERSION || loaded->file_size != cache_file.size()) {
+        std::cerr << dir_cache_path << " is not an os_find directory cache of version " << CACHE_VERSION << std::endl;
+        return false;
+    }
+    header = loaded;
+    cached_directories = reinterpret_cast<CachedDirectory const*>(mapping + header->directories_offset);
+    cached_inodes = reinterpret_cast<uint64_t const*>(mapping + header->inodes_offset);
+    cached_types = reinterpret_cast<uint8_t const*>(mapping + header->types_offset);
+    cached_name_offsets = reinterpret_cast<uint64_t const*>(mapping + header->name_offsets_offset);
+    cached_names = mapping + header->names_offset;
+    confirmed.assign(header->directory_count, false);
+    return true;
+}
+
+bool directory_identity(int dir_fd, struct statx& identity) {
+    return sys_statx(dir_fd, "", AT_EMPTY_PATH, IDENTITY_MASK, &identity) == 0 &&
+           (identity.stx_mask & IDENTITY_MASK) == IDENTITY_MASK;
+}
+
+bool cached_listing(struct statx const& identity, std::vector<ListedEntry>& entries) {
+    if (header == nullptr) {
+        return false;
+    }
+    CachedDirectory key = describe(identity);
+    if (key.mtime == UNSTABLE_TIME) {
+        return false;
+    }
+    CachedDirectory const* end = cached_directories + header->directory_count;
+    CachedDirectory const* found = std::lower_bound(cached_directories, end, key, key_less);
+    if (found == end || !same_key(*found, key) || found->mtime != key.mtime || found->ctime != key.ctime) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> guard(stored_mutex);
+        auto position = static_cast<size_t>(found - cached_directories);
+        if (!confirmed[position]) {
+            confirmed[position] = true;
+            confirmed_count++;
+        }
+    }
+
+    entries.reserve(found->entry_count);
+    for (uint64_t i = found->first_entry; i < found->first_entry + found->entry_count; i++) {
+        entries.push_back(ListedEntry{std::string(cached_names + cached_name_offsets[i],
+                                              cached_name_offsets[i + 1] - cached_name_offsets[i]),
+                                  cached_inodes[i], cached_types[i]});
+    }
+    return true;
+}
+
+void store_listing(struct statx const& identity, std::vector<ListedEntry> const& entries) {
+    StoredListing listing{describe(identity), {}};
+    // an unstable listing is stored without entries, only to replace the outdated one
+    if (listing.directory.mtime != UNSTABLE_TIME) {
+        listing.entries = entries;
+    }
+    std::lock_guard<std::mutex> guard(stored_mutex);
+    stored.push_back(std::move(listing));
+}
+
+bool save_dir_cache() {
+    uint64_t old_count = header == nullptr ? 0 : header->directory_count;
+    if (stored.empty() && confirmed_count == old_count) {
+        return true;
+    }
+    std::sort(stored.begin(), stored.end(), [](StoredListing const& a, StoredListing const& b) {
+        return key_less(a.directory, b.directory);
+    });
+
+    std::vector<CachedDirectory> directories;
+    std::vector<uint64_t> inodes;
+    std::vector<uint8_t> types;
+    std::vector<uint64_t> name_offsets;
+    std::vector<char> names;
+    auto add_entry = [&](const char* name, size_t length, uint64_t ino, uint8_t type) {
+        inodes.push_back(ino);
+        types.push_back(type);
+        name_offsets.push_back(names.size());
+        names.insert(names.end(), name, name + length);
+    };
+
+    // merges the confirmed listings of the old cache with the fresh listings, which replace
+    // old ones of the same directory
+    uint64_t old = 0;
+    size_t fresh = 0;
+    while (old < old_count || fresh < stored.size()) {
+        bool take_fresh = old == old_count ||
+                          (fresh < stored.size() && !key_less(cached_directories[old], stored[fresh].directory));
+        CachedDirectory directory;
+        if (take_fresh) {
+            StoredListing const& listing = stored[fresh++];
+            if (old < old_count && same_key(cached_directories[old], listing.directory)) {
+                old++;
+            }
+            // the same directory may have been read twice, e.g. through a bind mount
+            while (fresh < stored.size() && same_key(stored[fresh].directory, listing.directory)) {
+                fresh++;
+            }
+            directory = listing.directory;
+            directory.first_entry = inodes.size();
+            directory.entry_count = listing.entries.size();
+            for (auto const& entry : listing.entries) {
+                add_entry(entry.name.data(), entry.name.size(), entry.ino, entry.type);
+            }
+        } else if (!confirmed[old]) {
+            // not reached by this run, it may be gone
+            old++;
+            continue;
+        } else {
+            CachedDirectory const& cached = cached_directories[old++];
+            directory = cached;
+            directory.first_entry = inodes.size();
+            for (uint64_t i = cached.first_entry; i < cached.first_entry + cached.entry_count; i++) {
+                add_entry(cached_names + cached_name_offsets[i], cached_name_offsets[i + 1] - cached_name_offsets[i],
+                          cached_inodes[i], cached_types[i]);
+            }
+        }
+        directories.push_back(directory);
+    }
+    name_offsets.push_back(names.size());
+
+    CacheHeader out{};
+    memcpy(out.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    out.version = CACHE_VERSION;
+    out.directory_count = directories.size();
+    out.entry_count = inodes.size();
+
+    SectionWriter writer;
+    if (!writer.open(dir_cache_path)) {
+        return false;
+    }
+    writer.section(&out, sizeof(out));
+    out.directories_offset = writer.section(directories.data(), directories.size() * sizeof(CachedDirectory));
+    out.inodes_offset = writer.section(inodes.data(), inodes.size() * sizeof(uint64_t));
+    out.types_offset = writer.section(types.data(), types.size());
+    out.name_offsets_offset = writer.section(name_offsets.data(), name_offsets.size() * sizeof(uint64_t));
+    out.names_offset = writer.section(names.data(), names.size());
+    out.file_size = writer.size();
+    return writer.commit(&out, sizeof(out));
+}
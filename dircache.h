@@ -0,0 +1,39 @@
+#ifndef OS_FIND_DIRCACHE_H
+#define OS_FIND_DIRCACHE_H
+
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include "directory.h"
+
+// File of the directory listing cache, empty if -dir-cache is not used.
+// The cache keeps the raw listings (names, inodes and types) of the directories read by
+// previous runs, keyed by (dev, ino) and valid while mtime and ctime stay the same.
+// Checking them needs a statx of the directory instead of reading it with getdents64,
+// which is much cheaper on network file systems caching attributes.
+extern std::string dir_cache_path;
+
+inline bool dir_cache_enabled() {
+    return !dir_cache_path.empty();
+}
+
+// Maps the cache file; a missing file is an empty cache.
+// Returns false if the file exists but can not be used.
+bool load_dir_cache();
+
+// The identity of an open directory, read with a statx asking only for it
+bool directory_identity(int dir_fd, struct statx& identity);
+
+// Fills entries from the cache if the directory did not change since it was cached
+bool cached_listing(struct statx const& identity, std::vector<ListedEntry>& entries);
+
+// Remembers a fresh listing, to be written by save_dir_cache()
+void store_listing(struct statx const& identity, std::vector<ListedEntry> const& entries);
+
+// Writes the cache back if some listing was stored or some cached listing was not used.
+// Only the listings this run read or found unchanged are kept, so that the directories
+// removed since do not stay in the cache forever.
+bool save_dir_cache();
+
+#endif //OS_FIND_DIRCACHE_H
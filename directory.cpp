@@ -0,0 +1,76 @@
+#include "directory.h"
+
+#include <dirent.h>
+#include <cstring>
+
+#include "entry.h"
+#include "fd.h"
+#include "stats.h"
+
+namespace {
+
+const size_t LIST_BUFFER_SIZE = 64 * 1024;
+
+} // namespace
+
+unsigned char entry_type(int dir_fd, const char* name) {
+    struct statx stats{};
+    if (sys_statx(dir_fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, STATX_TYPE, &stats) == -1) {
+        return DT_UNKNOWN;
+    }
+    return static_cast<unsigned char>(IFTODT(stats.stx_mode));
+}
+
+void resolve_types(int dir_fd, std::vector<ListedEntry>& entries) {
+    for (auto& entry : entries) {
+        if (entry.type == DT_UNKNOWN) {
+            entry.type = entry_type(dir_fd, entry.name.c_str());
+        }
+    }
+}
+
+bool list_directory(int dir_fd, std::vector<ListedEntry>& entries) {
+    static thread_local char buf[LIST_BUFFER_SIZE];
+
+    while (true) {
+        long read = sys_getdents64(dir_fd, buf, LIST_BUFFER_SIZE);
+        if (read == -1) {
+            return false;
+        }
+        if (read == 0) {
+            return true;
+        }
+        run_stats.dirent_bytes += read;
+
+        for (char* ptr = buf; ptr < buf + read;) {
+            auto entry = reinterpret_cast<linux_dirent64*>(ptr);
+            ptr += entry->d_reclen;
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            entries.push_back(ListedEntry{entry->d_name, entry->d_ino, entry->d_type});
+        }
+    }
+}
+
+namespace {
+
+// byte i of the path component of the entry, -1 past its end
+int component_byte(ListedEntry const& entry, size_t i) {
+    if (i < entry.name.size()) {
+        return static_cast<unsigned char>(entry.name[i]);
+    }
+    return i == entry.name.size() && entry.type == DT_DIR ? '/' : -1;
+}
+
+} // namespace
+
+bool listed_path_less(ListedEntry const& a, ListedEntry const& b) {
+    for (size_t i = 0;; i++) {
+        int byte_a = component_byte(a, i);
+        int byte_b = component_byte(b, i);
+        if (byte_a != byte_b || byte_a == -1) {
+            return byte_a < byte_b;
+        }
+    }
+}
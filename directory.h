@@ -0,0 +1,32 @@
+#ifndef OS_FIND_DIRECTORY_H
+#define OS_FIND_DIRECTORY_H
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+struct ListedEntry {
+    std::string name;
+    ino64_t ino;
+    unsigned char type;
+};
+
+// Reads all entries of an open directory except . and ..
+// Returns false if getdents64 failed, with errno set.
+bool list_directory(int dir_fd, std::vector<ListedEntry>& entries);
+
+// Type of an entry as a DT_ constant, for entries whose dirent has DT_UNKNOWN.
+// Asks statx for the type only. Returns DT_UNKNOWN if that failed.
+unsigned char entry_type(int dir_fd, const char* name);
+
+// Replaces DT_UNKNOWN in a listing with the types from entry_type,
+// for the code that needs the types of all entries before visiting them.
+void resolve_types(int dir_fd, std::vector<ListedEntry>& entries);
+
+// Orders entries as their paths sort bytewise, a directory counting as its name and '/'.
+// Visiting the entries of every directory in this order yields paths in sorted order,
+// as long as the directories themselves are not among them.
+// The types of the entries must be resolved.
+bool listed_path_less(ListedEntry const& a, ListedEntry const& b);
+
+#endif //OS_FIND_DIRECTORY_H
@@ -0,0 +1,219 @@
+#include "duplicates.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "fd.h"
+#include "hash.h"
+#include "output.h"
+#include "parallel.h"
+
+bool find_duplicates = false;
+bool confirm_sha1 = false;
+
+namespace {
+
+const size_t EDGE_SIZE = 4096;
+const size_t READ_BUFFER_SIZE = 1 << 20;
+
+struct Candidate {
+    std::string path;
+    uint32_t dir_length;
+    EntryInfo info;
+    bool readable;
+    // hash of the stage that is running
+    uint64_t hash;
+    unsigned char sha1[Sha1::DIGEST_SIZE];
+};
+
+std::vector<Candidate> candidates;
+
+bool read_at(int fd, char* buf, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t read_size = pread(fd, buf, size, offset);
+        if (read_size == -1 && errno == EINTR) {
+            continue;
+        }
+        if (read_size <= 0) {
+            return false;
+        }
+        buf += read_size;
+        size -= static_cast<size_t>(read_size);
+        offset += read_size;
+    }
+    return true;
+}
+
+void report_read_error(Candidate& candidate) {
+    int saved_errno = errno;
+    std::cerr << "Error reading " << candidate.path << std::endl;
+    std::cerr << strerror(saved_errno) << std::endl;
+    candidate.readable = false;
+}
+
+// XXH64 of the first and the last EDGE_SIZE bytes, the whole file if it is not larger
+void hash_edges(Candidate& candidate) {
+    FileDescriptor fd = open_contents(candidate.path.c_str());
+    auto size = static_cast<size_t>(candidate.info.stats.st_size);
+    char buf[2 * EDGE_SIZE];
+    size_t head = std::min(size, EDGE_SIZE);
+    size_t tail = std::min(size - head, EDGE_SIZE);
+    if (!fd.valid() || !read_at(fd.get(), buf, head, 0) ||
+        !read_at(fd.get(), buf + head, tail, static_cast<off_t>(size - tail))) {
+        report_read_error(candidate);
+        return;
+    }
+    Xxh64 hash;
+    hash.update(buf, head + tail);
+    candidate.hash = hash.digest();
+}
+
+void hash_contents(Candidate& candidate, bool sha1) {
+    FileDescriptor fd = open_contents(candidate.path.c_str());
+    if (!fd.valid()) {
+        report_read_error(candidate);
+        return;
+    }
+    posix_fadvise(fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+    static thread_local std::vector<char> buf(READ_BUFFER_SIZE);
+    Xxh64 fast;
+    Sha1 secure;
+    while (true) {
+        ssize_t read_size = read(fd.get(), buf.data(), buf.size());
+        if (read_size == -1 && errno == EINTR) {
+            continue;
+        }
+        if (read_size == -1) {
+            report_read_error(candidate);
+            return;
+        }
+        if (read_size == 0) {
+            break;
+        }
+        if (sha1) {
+            secure.update(buf.data(), static_cast<size_t>(read_size));
+        } else {
+            fast.update(buf.data(), static_cast<size_t>(read_size));
+        }
+    }
+    if (sha1) {
+        secure.finish(candidate.sha1);
+    } else {
+        candidate.hash = fast.digest();
+    }
+}
+
+bool same_size(Candidate const& a, Candidate const& b) {
+    return a.info.stats.st_size == b.info.stats.st_size;
+}
+
+// Keeps the candidates that have an equal one by the key and drops the rest.
+// Candidates are grouped by size and then by the key.
+template<typename Less, typename Equal>
+void keep_groups(Less less, Equal equal) {
+    std::vector<Candidate*> order;
+    order.reserve(candidates.size());
+    for (auto& candidate : candidates) {
+        if (candidate.readable) {
+            order.push_back(&candidate);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&less](Candidate const* a, Candidate const* b) {
+        if (a->info.stats.st_size != b->info.stats.st_size) {
+            return a->info.stats.st_size > b->info.stats.st_size;
+        }
+        return less(*a, *b);
+    });
+
+    std::vector<Candidate> kept;
+    for (size_t start = 0; start < order.size();) {
+        size_t end = start + 1;
+        while (end < order.size() && same_size(*order[start], *order[end]) && equal(*order[start], *order[end])) {
+            end++;
+        }
+        if (end - start > 1) {
+            for (size_t i = start; i < end; i++) {
+                kept.push_back(std::move(*order[i]));
+            }
+        }
+        start = end;
+    }
+    candidates.swap(kept);
+}
+
+} // namespace
+
+void add_duplicate_candidate(std::string const& dir_path, const char* name, EntryInfo const& info) {
+    if (info.stats.st_size == 0) {
+        return;
+    }
+    candidates.push_back(Candidate{dir_path + name, static_cast<uint32_t>(dir_path.size()), info, true, 0, {}});
+}
+
+void report_duplicates() {
+    // one path per inode: hardlinks share their contents and are no duplicates
+    std::sort(candidates.begin(), candidates.end(), [](Candidate const& a, Candidate const& b) {
+        if (a.info.stats.st_dev != b.info.stats.st_dev) {
+            return a.info.stats.st_dev < b.info.stats.st_dev;
+        }
+        if (a.info.stats.st_ino != b.info.stats.st_ino) {
+            return a.info.stats.st_ino < b.info.stats.st_ino;
+        }
+        return a.path < b.path;
+    });
+    candidates.erase(std::unique(candidates.begin(), candidates.end(), [](Candidate const& a, Candidate const& b) {
+        return a.info.stats.st_dev == b.info.stats.st_dev && a.info.stats.st_ino == b.info.stats.st_ino;
+    }), candidates.end());
+
+    auto by_hash_less = [](Candidate const& a, Candidate const& b) { return a.hash < b.hash; };
+    auto by_hash_equal = [](Candidate const& a, Candidate const& b) { return a.hash == b.hash; };
+
+    keep_groups([](Candidate const&, Candidate const&) { return false; },
+                [](Candidate const&, Candidate const&) { return true; });
+
+    parallel_for(candidates.size(), [](size_t i) { hash_edges(candidates[i]); });
+    keep_groups(by_hash_less, by_hash_equal);
+
+    // files up to twice EDGE_SIZE were read completely already
+    parallel_for(candidates.size(), [](size_t i) {
+        if (static_cast<size_t>(candidates[i].info.stats.st_size) > 2 * EDGE_SIZE) {
+            hash_contents(candidates[i], false);
+        }
+    });
+    keep_groups(by_hash_less, by_hash_equal);
+
+    if (confirm_sha1) {
+        parallel_for(candidates.size(), [](size_t i) { hash_contents(candidates[i], true); });
+        keep_groups([](Candidate const& a, Candidate const& b) {
+                        return memcmp(a.sha1, b.sha1, Sha1::DIGEST_SIZE) < 0;
+                    },
+                    [](Candidate const& a, Candidate const& b) {
+                        return memcmp(a.sha1, b.sha1, Sha1::DIGEST_SIZE) == 0;
+                    });
+    }
+
+    // groups are contiguous, the largest files first; each group is ordered by path
+    for (size_t start = 0; start < candidates.size();) {
+        size_t end = start + 1;
+        while (end < candidates.size() && same_size(candidates[start], candidates[end]) &&
+               candidates[start].hash == candidates[end].hash &&
+               (!confirm_sha1 || memcmp(candidates[start].sha1, candidates[end].sha1, Sha1::DIGEST_SIZE) == 0)) {
+            end++;
+        }
+        std::sort(candidates.begin() + start, candidates.begin() + end,
+                  [](Candidate const& a, Candidate const& b) { return a.path < b.path; });
+        for (size_t i = start; i < end; i++) {
+            Candidate const& candidate = candidates[i];
+            std::string dir_path = candidate.path.substr(0, candidate.dir_length);
+            emit(dir_path, candidate.path.c_str() + candidate.dir_length, candidate.info);
+        }
+        emit_group_end();
+        start = end;
+    }
+    candidates.clear();
+}
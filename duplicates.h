@@ -0,0 +1,23 @@
+#ifndef OS_FIND_DUPLICATES_H
+#define OS_FIND_DUPLICATES_H
+
+#include <string>
+
+#include "entry.h"
+
+// -duplicates: instead of the matches, output the groups of matched files with equal contents
+extern bool find_duplicates;
+// -duplicates-sha1: confirm equal contents with SHA-1 besides XXH64
+extern bool confirm_sha1;
+
+// Takes a matched file, with its stats. Not thread-safe, the caller serializes the calls.
+void add_duplicate_candidate(std::string const& dir_path, const char* name, EntryInfo const& info);
+
+// Narrows the candidates down in stages, each reading more of fewer files:
+// files of a unique size are dropped without reading them, then files whose first and
+// last 4 KiB differ, and only the rest is hashed completely, in parallel.
+// Hardlinks of one inode are read once and reported once, empty files are skipped.
+// Each group is output as its paths followed by an empty record.
+void report_duplicates();
+
+#endif //OS_FIND_DUPLICATES_H
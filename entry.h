@@ -0,0 +1,25 @@
+#ifndef OS_FIND_ENTRY_H
+#define OS_FIND_ENTRY_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// What is known about a matched entry: the dirent fields always,
+// the stats only if matches() had to read them.
+struct EntryInfo {
+    ino64_t ino;
+    unsigned char type;
+    // the STATX_ fields of stats that were read, 0 if none
+    unsigned stats_mask;
+    struct stat stats;
+};
+
+#endif //OS_FIND_ENTRY_H
@@ -0,0 +1,98 @@
+#include "fd.h"
+
+#include <sys/sysmacros.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+FileDescriptor::FileDescriptor(FileDescriptor&& other) noexcept : fd(other.fd) {
+    other.fd = -1;
+}
+
+FileDescriptor& FileDescriptor::operator=(FileDescriptor&& other) noexcept {
+    if (this != &other) {
+        reset(other.fd);
+        other.fd = -1;
+    }
+    return *this;
+}
+
+FileDescriptor::~FileDescriptor() {
+    reset();
+}
+
+void FileDescriptor::reset(int new_fd) {
+    if (fd != -1) {
+        // errno of the failed call may still be needed by the caller
+        int saved_errno = errno;
+        sys_close(fd);
+        errno = saved_errno;
+    }
+    fd = new_fd;
+}
+
+void print_error() {
+    std::cerr << strerror(errno) << std::endl;
+}
+
+bool write_fully(int fd, const void* data, size_t size) {
+    for (size_t done = 0; done < size;) {
+        ssize_t written = write(fd, static_cast<const char*>(data) + done, size - done);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += static_cast<size_t>(written);
+    }
+    return true;
+}
+
+int stat_entry(int dir_fd, const char* name, unsigned mask, struct stat* buf, unsigned& returned_mask) {
+    struct statx stats{};
+    int result = sys_statx(dir_fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, mask, &stats);
+    if (result == -1) {
+        return result;
+    }
+    returned_mask = stats.stx_mask;
+    memset(buf, 0, sizeof(*buf));
+    buf->st_dev = makedev(stats.stx_dev_major, stats.stx_dev_minor);
+    buf->st_ino = stats.stx_ino;
+    buf->st_mode = stats.stx_mode;
+    buf->st_nlink = stats.stx_nlink;
+    buf->st_uid = stats.stx_uid;
+    buf->st_gid = stats.stx_gid;
+    buf->st_rdev = makedev(stats.stx_rdev_major, stats.stx_rdev_minor);
+    buf->st_size = static_cast<off_t>(stats.stx_size);
+    buf->st_blksize = stats.stx_blksize;
+    buf->st_blocks = static_cast<blkcnt_t>(stats.stx_blocks);
+    buf->st_atim = {stats.stx_atime.tv_sec, stats.stx_atime.tv_nsec};
+    buf->st_mtim = {stats.stx_mtime.tv_sec, stats.stx_mtime.tv_nsec};
+    buf->st_ctim = {stats.stx_ctime.tv_sec, stats.stx_ctime.tv_nsec};
+    return result;
+}
+
+FileDescriptor open_directory(int dir_fd, const char* name) {
+    const int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+
+    int fd = sys_openat(dir_fd, name, flags | O_NOATIME);
+    if (fd == -1 && errno == EPERM) {
+        fd = sys_openat(dir_fd, name, flags);
+    }
+    return FileDescriptor(fd);
+}
+
+FileDescriptor open_contents(const char* path) {
+    const int flags = O_RDONLY | O_CLOEXEC;
+
+    int fd = sys_openat(AT_FDCWD, path, flags | O_NOATIME);
+    if (fd == -1 && errno == EPERM) {
+        fd = sys_openat(AT_FDCWD, path, flags);
+    }
+    return FileDescriptor(fd);
+}
+
+FileDescriptor open_path(int dir_fd, const char* name) {
+    return FileDescriptor(sys_openat(dir_fd, name, O_PATH | O_NOFOLLOW | O_CLOEXEC));
+}
@@ -0,0 +1,126 @@
+#ifndef OS_FIND_FD_H
+#define OS_FIND_FD_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ctime>
+
+#include "stats.h"
+
+// Syscalls issued by the traversal go through these wrappers,
+// so that --stats can count and time them.
+
+inline long sys_getdents64(int fd, void* buf, size_t size) {
+    uint64_t start = stats_enabled() ? now_ns() : 0;
+    long read = syscall(SYS_getdents64, fd, buf, size);
+    if (stats_enabled()) {
+        record_syscall(Syscall::GETDENTS, start, read == -1, read > 0 ? static_cast<uint64_t>(read) : 0);
+    }
+    return read;
+}
+
+inline int sys_openat(int dir_fd, const char* name, int flags) {
+    uint64_t start = stats_enabled() ? now_ns() : 0;
+    int fd = openat(dir_fd, name, flags);
+    if (stats_enabled()) {
+        record_syscall(Syscall::OPENAT, start, fd == -1);
+    }
+    return fd;
+}
+
+inline int sys_fstat(int fd, struct stat* buf) {
+    uint64_t start = stats_enabled() ? now_ns() : 0;
+    int result = fstat(fd, buf);
+    if (stats_enabled()) {
+        record_syscall(Syscall::FSTAT, start, result == -1);
+    }
+    return result;
+}
+
+// Asks only for the fields in mask, which lets network file systems
+// answer from cached attributes instead of a round trip
+inline int sys_statx(int dir_fd, const char* name, int flags, unsigned mask, struct statx* buf) {
+    uint64_t start = stats_enabled() ? now_ns() : 0;
+    int result = statx(dir_fd, name, flags, mask, buf);
+    if (stats_enabled()) {
+        record_syscall(Syscall::STATX, start, result == -1);
+    }
+    return result;
+}
+
+inline int sys_close(int fd) {
+    uint64_t start = stats_enabled() ? now_ns() : 0;
+    int result = close(fd);
+    if (stats_enabled()) {
+        record_syscall(Syscall::CLOSE, start, result == -1);
+    }
+    return result;
+}
+
+inline ssize_t sys_writev(int fd, const iovec* parts, int count) {
+    uint64_t start = stats_enabled() ? now_ns() : 0;
+    ssize_t written = writev(fd, parts, count);
+    if (stats_enabled()) {
+        record_syscall(Syscall::WRITE, start, written == -1, written > 0 ? static_cast<uint64_t>(written) : 0);
+    }
+    return written;
+}
+
+// Owns a file descriptor and closes it when going out of scope,
+// so that no early return can leak it.
+class FileDescriptor {
+public:
+    FileDescriptor() = default;
+    explicit FileDescriptor(int fd) : fd(fd) {}
+    FileDescriptor(FileDescriptor&& other) noexcept;
+    FileDescriptor& operator=(FileDescriptor&& other) noexcept;
+    FileDescriptor(FileDescriptor const&) = delete;
+    FileDescriptor& operator=(FileDescriptor const&) = delete;
+    ~FileDescriptor();
+
+    int get() const { return fd; }
+    bool valid() const { return fd != -1; }
+    void reset(int new_fd = -1);
+
+private:
+    int fd = -1;
+};
+
+// Prints the error of the last failed call to stderr, after the message about what failed
+void print_error();
+
+// Writes all size bytes, continuing after partial writes and EINTR.
+// Returns false with errno set if writing failed.
+bool write_fully(int fd, const void* data, size_t size);
+
+// Nanoseconds since the epoch, as the indexes and the time predicates compare them
+inline int64_t to_ns(timespec const& time) {
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+inline int64_t to_ns(statx_timestamp const& time) {
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+// Reads the stats of an entry with a single statx instead of open, fstat and close,
+// asking only for the fields in mask, and converts them into a struct stat.
+// Fields outside the returned mask are zero. Does not follow a trailing symlink.
+int stat_entry(int dir_fd, const char* name, unsigned mask, struct stat* buf, unsigned& returned_mask);
+
+// Opens a directory for reading its entries.
+// Tries O_NOATIME first and silently retries without it when the kernel refuses
+// (O_NOATIME is only allowed for the owner of the directory or CAP_FOWNER).
+FileDescriptor open_directory(int dir_fd, const char* name);
+
+// Opens a file for reading its contents, with O_NOATIME when the kernel allows it
+FileDescriptor open_contents(const char* path);
+
+// Opens an entry for metadata access only. O_PATH needs no read permission,
+// does not touch atime and does not follow a trailing symlink.
+FileDescriptor open_path(int dir_fd, const char* name);
+
+#endif //OS_FIND_FD_H
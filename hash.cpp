@@ -0,0 +1,409 @@
+#include "hash.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define OS_FIND_SHA_NI 1
+#endif
+
+namespace {
+
+const uint64_t PRIME64_1 = 11400714785074694791ULL;
+const uint64_t PRIME64_2 = 14029467366897019727ULL;
+const uint64_t PRIME64_3 = 1609587929392839161ULL;
+const uint64_t PRIME64_4 = 9650029242287828579ULL;
+const uint64_t PRIME64_5 = 2870177450012600261ULL;
+
+inline uint64_t rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint32_t rotl32(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+// XXH64 is defined on little-endian words, which is what x86 loads
+inline uint64_t read64(const unsigned char* in) {
+    uint64_t value;
+    memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+inline uint32_t read32(const unsigned char* in) {
+    uint32_t value;
+    memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+inline uint32_t read32_big(const unsigned char* in) {
+    return __builtin_bswap32(read32(in));
+}
+
+inline uint64_t xxh_round(uint64_t accumulator, uint64_t input) {
+    accumulator += input * PRIME64_2;
+    return rotl64(accumulator, 31) * PRIME64_1;
+}
+
+inline uint64_t xxh_merge(uint64_t hash, uint64_t accumulator) {
+    hash ^= xxh_round(0, accumulator);
+    return hash * PRIME64_1 + PRIME64_4;
+}
+
+void sha1_blocks_portable(uint32_t* state, const unsigned char* data, size_t blocks) {
+    for (; blocks > 0; blocks--, data += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            w[i] = read32_big(data + 4 * i);
+        }
+        for (int i = 16; i < 80; i++) {
+            w[i] = rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+            uint32_t t = rotl32(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl32(b, 30);
+            b = a;
+            a = t;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+const uint32_t SHA256_K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+inline uint32_t rotr32(uint32_t value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+void sha256_blocks_portable(uint32_t* state, const unsigned char* data, size_t blocks) {
+    for (; blocks > 0; blocks--, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = read32_big(data + 4 * i);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+            uint32_t choice = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + choice + SHA256_K[i] + w[i];
+            uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + s0 + majority;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef OS_FIND_SHA_NI
+
+// The SHA extensions run four rounds per instruction. The message schedule is kept in
+// four registers of four words each, which are reused round-robin; the loops over the
+// groups of rounds must be unrolled for the array to live in registers.
+
+__attribute__((target("sha,sse4.1,ssse3")))
+void sha1_blocks_sha_ni(uint32_t* state, const unsigned char* data, size_t blocks) {
+    const __m128i byte_order = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1b);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+    for (; blocks > 0; blocks--, data += 64) {
+        __m128i abcd_saved = abcd;
+        __m128i e0_saved = e0;
+        __m128i e1 = _mm_setzero_si128();
+        __m128i message[4];
+#pragma GCC unroll 20
+        for (int group = 0; group < 20; group++) {
+            if (group < 4) {
+                message[group] = _mm_shuffle_epi8(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * group)), byte_order);
+            }
+            // e of the group alternates between two registers
+            __m128i& e = group % 2 == 0 ? e0 : e1;
+            __m128i& next_e = group % 2 == 0 ? e1 : e0;
+            if (group == 0) {
+                e = _mm_add_epi32(e, message[0]);
+            } else {
+                e = _mm_sha1nexte_epu32(e, message[group % 4]);
+            }
+            next_e = abcd;
+            if (group >= 3 && group <= 18) {
+                message[(group + 1) % 4] = _mm_sha1msg2_epu32(message[(group + 1) % 4], message[group % 4]);
+            }
+            switch (group / 5) {
+                case 0: abcd = _mm_sha1rnds4_epu32(abcd, e, 0); break;
+                case 1: abcd = _mm_sha1rnds4_epu32(abcd, e, 1); break;
+                case 2: abcd = _mm_sha1rnds4_epu32(abcd, e, 2); break;
+                default: abcd = _mm_sha1rnds4_epu32(abcd, e, 3); break;
+            }
+            if (group >= 1 && group <= 16) {
+                message[(group + 3) % 4] = _mm_sha1msg1_epu32(message[(group + 3) % 4], message[group % 4]);
+            }
+            if (group >= 2 && group <= 17) {
+                message[(group + 2) % 4] = _mm_xor_si128(message[(group + 2) % 4], message[group % 4]);
+            }
+        }
+        e0 = _mm_sha1nexte_epu32(e0, e0_saved);
+        abcd = _mm_add_epi32(abcd, abcd_saved);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+
+__attribute__((target("sha,sse4.1,ssse3")))
+void sha256_blocks_sha_ni(uint32_t* state, const unsigned char* data, size_t blocks) {
+    const __m128i byte_order = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    // the instructions keep the state as ABEF and CDGH
+    __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xb1);
+    __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1b);
+    __m128i abef = _mm_alignr_epi8(dcba, efgh, 8);
+    __m128i cdgh = _mm_blend_epi16(efgh, dcba, 0xf0);
+
+    for (; blocks > 0; blocks--, data += 64) {
+        __m128i abef_saved = abef;
+        __m128i cdgh_saved = cdgh;
+        __m128i message[4];
+#pragma GCC unroll 16
+        for (int group = 0; group < 16; group++) {
+            if (group < 4) {
+                message[group] = _mm_shuffle_epi8(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * group)), byte_order);
+            }
+            __m128i words = _mm_add_epi32(message[group % 4],
+                                          _mm_loadu_si128(reinterpret_cast<const __m128i*>(SHA256_K + 4 * group)));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, words);
+            if (group >= 3 && group <= 14) {
+                __m128i& next = message[(group + 1) % 4];
+                next = _mm_add_epi32(next, _mm_alignr_epi8(message[group % 4], message[(group + 3) % 4], 4));
+                next = _mm_sha256msg2_epu32(next, message[group % 4]);
+            }
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(words, 0x0e));
+            if (group >= 1 && group <= 12) {
+                message[(group + 3) % 4] = _mm_sha256msg1_epu32(message[(group + 3) % 4], message[group % 4]);
+            }
+        }
+        abef = _mm_add_epi32(abef, abef_saved);
+        cdgh = _mm_add_epi32(cdgh, cdgh_saved);
+    }
+
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(feba, dchg, 0xf0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+bool has_sha_ni() {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3)) {
+        return false;
+    }
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+}
+
+#endif
+
+using BlockFunction = void (*)(uint32_t* state, const unsigned char* data, size_t blocks);
+
+// chosen once by the CPU the binary runs on
+struct BlockFunctions {
+    BlockFunction sha1 = sha1_blocks_portable;
+    BlockFunction sha256 = sha256_blocks_portable;
+
+    BlockFunctions() {
+#ifdef OS_FIND_SHA_NI
+        if (has_sha_ni()) {
+            sha1 = sha1_blocks_sha_ni;
+            sha256 = sha256_blocks_sha_ni;
+        }
+#endif
+    }
+};
+
+const BlockFunctions block_functions;
+
+// The buffering shared by SHA-1 and SHA-256, which both work on 64-byte blocks
+void feed_blocks(BlockFunction process, uint32_t* state, unsigned char* pending, size_t& pending_size,
+                 const unsigned char* in, size_t size) {
+    if (pending_size > 0) {
+        size_t taken = size < 64 - pending_size ? size : 64 - pending_size;
+        memcpy(pending + pending_size, in, taken);
+        pending_size += taken;
+        in += taken;
+        size -= taken;
+        if (pending_size < 64) {
+            return;
+        }
+        process(state, pending, 1);
+        pending_size = 0;
+    }
+    process(state, in, size / 64);
+    in += size / 64 * 64;
+    size %= 64;
+    memcpy(pending, in, size);
+    pending_size = size;
+}
+
+// Pads the message with its length in bits and writes the state out big-endian
+void finish_blocks(BlockFunction process, uint32_t* state, size_t words, unsigned char* pending,
+                   size_t& pending_size, uint64_t total, unsigned char* digest) {
+    uint64_t bits = total * 8;
+    static const unsigned char PADDING[64] = {0x80};
+    size_t padding = pending_size < 56 ? 56 - pending_size : 120 - pending_size;
+    feed_blocks(process, state, pending, pending_size, PADDING, padding);
+    unsigned char length[8];
+    for (int i = 0; i < 8; i++) {
+        length[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+    }
+    feed_blocks(process, state, pending, pending_size, length, sizeof(length));
+    for (size_t i = 0; i < words; i++) {
+        uint32_t word = __builtin_bswap32(state[i]);
+        memcpy(digest + 4 * i, &word, sizeof(word));
+    }
+}
+
+} // namespace
+
+Xxh64::Xxh64(uint64_t seed) : seed(seed) {
+    accumulators[0] = seed + PRIME64_1 + PRIME64_2;
+    accumulators[1] = seed + PRIME64_2;
+    accumulators[2] = seed;
+    accumulators[3] = seed - PRIME64_1;
+}
+
+void Xxh64::update(const void* data, size_t size) {
+    auto in = static_cast<const unsigned char*>(data);
+    total += size;
+    if (pending_size + size < 32) {
+        memcpy(pending + pending_size, in, size);
+        pending_size += size;
+        return;
+    }
+    if (pending_size > 0) {
+        size_t taken = 32 - pending_size;
+        memcpy(pending + pending_size, in, taken);
+        for (int i = 0; i < 4; i++) {
+            accumulators[i] = xxh_round(accumulators[i], read64(pending + 8 * i));
+        }
+        in += taken;
+        size -= taken;
+        pending_size = 0;
+    }
+    for (; size >= 32; in += 32, size -= 32) {
+        for (int i = 0; i < 4; i++) {
+            accumulators[i] = xxh_round(accumulators[i], read64(in + 8 * i));
+        }
+    }
+    memcpy(pending, in, size);
+    pending_size = size;
+}
+
+uint64_t Xxh64::digest() const {
+    uint64_t hash;
+    if (total >= 32) {
+        hash = rotl64(accumulators[0], 1) + rotl64(accumulators[1], 7) +
+               rotl64(accumulators[2], 12) + rotl64(accumulators[3], 18);
+        for (int i = 0; i < 4; i++) {
+            hash = xxh_merge(hash, accumulators[i]);
+        }
+    } else {
+        hash = seed + PRIME64_5;
+    }
+    hash += total;
+
+    const unsigned char* in = pending;
+    size_t size = pending_size;
+    for (; size >= 8; in += 8, size -= 8) {
+        hash ^= xxh_round(0, read64(in));
+        hash = rotl64(hash, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (size >= 4) {
+        hash ^= static_cast<uint64_t>(read32(in)) * PRIME64_1;
+        hash = rotl64(hash, 23) * PRIME64_2 + PRIME64_3;
+        in += 4;
+        size -= 4;
+    }
+    for (; size > 0; in++, size--) {
+        hash ^= *in * PRIME64_5;
+        hash = rotl64(hash, 11) * PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+Sha1::Sha1() : state{0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0} {}
+
+void Sha1::update(const void* data, size_t size) {
+    total += size;
+    feed_blocks(block_functions.sha1, state, pending, pending_size, static_cast<const unsigned char*>(data), size);
+}
+
+void Sha1::finish(unsigned char digest[DIGEST_SIZE]) {
+    finish_blocks(block_functions.sha1, state, 5, pending, pending_size, total, digest);
+}
+
+Sha256::Sha256() : state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19} {}
+
+void Sha256::update(const void* data, size_t size) {
+    total += size;
+    feed_blocks(block_functions.sha256, state, pending, pending_size, static_cast<const unsigned char*>(data), size);
+}
+
+void Sha256::finish(unsigned char digest[DIGEST_SIZE]) {
+    finish_blocks(block_functions.sha256, state, 8, pending, pending_size, total, digest);
+}
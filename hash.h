@@ -0,0 +1,54 @@
+#ifndef OS_FIND_HASH_H
+#define OS_FIND_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// XXH64, a fast non-cryptographic hash, fed in pieces
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0);
+    void update(const void* data, size_t size);
+    uint64_t digest() const;
+
+private:
+    uint64_t accumulators[4];
+    uint64_t seed;
+    uint64_t total = 0;
+    unsigned char pending[32];
+    size_t pending_size = 0;
+};
+
+// SHA-1 and SHA-256 as in FIPS 180-4, fed in pieces.
+// Both use the SHA extensions of x86 CPUs that have them.
+class Sha1 {
+public:
+    static const size_t DIGEST_SIZE = 20;
+
+    Sha1();
+    void update(const void* data, size_t size);
+    void finish(unsigned char digest[DIGEST_SIZE]);
+
+private:
+    uint32_t state[5];
+    uint64_t total = 0;
+    unsigned char pending[64];
+    size_t pending_size = 0;
+};
+
+class Sha256 {
+public:
+    static const size_t DIGEST_SIZE = 32;
+
+    Sha256();
+    void update(const void* data, size_t size);
+    void finish(unsigned char digest[DIGEST_SIZE]);
+
+private:
+    uint32_t state[8];
+    uint64_t total = 0;
+    unsigned char pending[64];
+    size_t pending_size = 0;
+};
+
+#endif //OS_FIND_HASH_H
@@ -0,0 +1,525 @@
+#include "index.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "directory.h"
+#include "fd.h"
+#include "mapped_file.h"
+#include "predicates.h"
+#include "progress.h"
+#include "stats.h"
+#include "varint.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+namespace {
+
+const char INDEX_MAGIC[8] = {'O', 'S', 'F', 'I', 'N', 'D', 'E', 'X'};
+const uint32_t INDEX_VERSION = 2;
+const uint32_t RESTART_INTERVAL = 16;
+const uint64_t NO_PARENT = UINT64_MAX;
+const uint64_t NO_DIRECTORY = UINT64_MAX;
+// the stats of the entries kept by the index
+const unsigned INDEXED_STATS = STATX_INO | STATX_SIZE | STATX_NLINK | STATX_MTIME;
+// stored as mtime of directories that may change without a visible mtime change
+const int64_t UNSTABLE_TIME = INT64_MIN;
+
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t restart_interval;
+    uint64_t directory_count;
+    uint64_t entry_count;
+    uint64_t restart_count;
+    uint64_t root_offset;
+    uint64_t root_length;
+    uint64_t directories_offset;
+    uint64_t directory_names_offset;
+    uint64_t directory_names_size;
+    uint64_t inodes_offset;
+    uint64_t sizes_offset;
+    uint64_t nlinks_offset;
+    uint64_t mtimes_offset;
+    uint64_t types_offset;
+    uint64_t restarts_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+    uint64_t file_size;
+};
+
+// The identity (dev, ino, mtime, ctime) of the directory lets a refresh
+// reuse its entries without reading it again while it stays the same.
+struct IndexDirectory {
+    uint64_t parent;
+    uint64_t first_entry;
+    uint64_t first_restart;
+    uint64_t name_offset;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime;
+    int64_t ctime;
+    uint32_t entry_count;
+    uint32_t name_length;
+};
+
+size_t shared_prefix(string const& a, string const& b) {
+    size_t length = std::min(a.size(), b.size());
+    size_t i = 0;
+    while (i < length && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+// Read-only view of an index file mapped into memory
+class IndexReader {
+public:
+    bool open(string const& db_path) {
+        if (!file.open(db_path)) {
+            return false;
+        }
+        mapping = file.data();
+        header = reinterpret_cast<IndexHeader const*>(mapping);
+        if (file.size() < sizeof(IndexHeader) ||
+            memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+            header->version != INDEX_VERSION || header->file_size != file.size()) {
+            cerr << db_path << " is not an os_find index of version " << INDEX_VERSION << endl;
+            return false;
+        }
+        directories = reinterpret_cast<IndexDirectory const*>(mapping + header->directories_offset);
+        directory_names = mapping + header->directory_names_offset;
+        inodes = reinterpret_cast<uint64_t const*>(mapping + header->inodes_offset);
+        sizes = reinterpret_cast<int64_t const*>(mapping + header->sizes_offset);
+        nlinks = reinterpret_cast<uint32_t const*>(mapping + header->nlinks_offset);
+        mtimes = reinterpret_cast<int64_t const*>(mapping + header->mtimes_offset);
+        types = reinterpret_cast<uint8_t const*>(mapping + header->types_offset);
+        restarts = reinterpret_cast<uint64_t const*>(mapping + header->restarts_offset);
+        names = mapping + header->names_offset;
+        madvise(const_cast<char*>(mapping), file.size(), MADV_SEQUENTIAL);
+        return true;
+    }
+
+    void query(string const& prefix, MatchCallback on_match) {
+        std::vector<string> paths(header->directory_count);
+        for (uint64_t d = 0; d < header->directory_count; d++) {
+            IndexDirectory const& dir = directories[d];
+            if (dir.parent == NO_PARENT) {
+                paths[d].assign(mapping + header->root_offset, header->root_length);
+            } else {
+                paths[d] = paths[dir.parent];
+                paths[d].append(directory_names + dir.name_offset, dir.name_length);
+                paths[d] += '/';
+            }
+            if (paths[d].compare(0, prefix.size(), prefix) != 0) {
+                continue;
+            }
+            bump(traversal_counters.directories);
+            query_directory(dir, paths[d], on_match);
+        }
+    }
+
+    string root() const {
+        return string(mapping + header->root_offset, header->root_length);
+    }
+
+    string directory_name(uint64_t d) const {
+        return string(directory_names + directories[d].name_offset, directories[d].name_length);
+    }
+
+    // Fills children with the subdirectories of every directory, in name order
+    void list_children(std::vector<std::vector<uint64_t>>& children) const {
+        children.assign(header->directory_count, std::vector<uint64_t>());
+        for (uint64_t d = 0; d < header->directory_count; d++) {
+            if (directories[d].parent != NO_PARENT) {
+                children[directories[d].parent].push_back(d);
+            }
+        }
+    }
+
+private:
+    friend class IndexBuilder;
+
+    // Decodes the names of the directory entries starting at the given restart
+    // and checks them, stopping after the first block if only one name can match
+    void query_directory(IndexDirectory const& dir, string const& path, MatchCallback on_match) {
+        if (dir.entry_count == 0) {
+            return;
+        }
+        uint64_t begin = 0;
+        bool single_block = false;
+        if (!name_target.empty() && !name_is_pattern()) {
+            begin = find_block(dir, name_target) * RESTART_INTERVAL;
+            single_block = true;
+        }
+
+        uint64_t end = single_block ? std::min<uint64_t>(begin + RESTART_INTERVAL, dir.entry_count)
+                                    : dir.entry_count;
+        const char* in = names + restarts[dir.first_restart + begin / RESTART_INTERVAL];
+        string name;
+        EntryInfo info{};
+        for (uint64_t i = begin; i < end; i++) {
+            uint64_t shared;
+            uint64_t suffix;
+            in = get_varint(in, shared);
+            in = get_varint(in, suffix);
+            name.resize(shared);
+            name.append(in, suffix);
+            in += suffix;
+            bump(traversal_counters.entries);
+
+            uint64_t e = dir.first_entry + i;
+            if (!type_wanted(types[e]) || !matches_dirent(inodes[e], name.c_str())) {
+                continue;
+            }
+            info.ino = inodes[e];
+            info.type = types[e];
+            info.stats_mask = INDEXED_STATS;
+            // a file is on the device of its directory, except for a file bind mount
+            info.stats.st_dev = static_cast<dev_t>(dir.dev);
+            info.stats.st_ino = inodes[e];
+            info.stats.st_size = sizes[e];
+            info.stats.st_nlink = nlinks[e];
+            info.stats.st_mtim.tv_sec = mtimes[e] / 1000000000;
+            info.stats.st_mtim.tv_nsec = mtimes[e] % 1000000000;
+            if (matches_stats(info.stats)) {
+                on_match(path, name.c_str(), info);
+            }
+        }
+    }
+
+    // index of the last restart block whose first name is not greater than name
+    uint64_t find_block(IndexDirectory const& dir, string const& name) {
+        uint64_t blocks = (dir.entry_count + RESTART_INTERVAL - 1) / RESTART_INTERVAL;
+        uint64_t low = 0;
+        uint64_t high = blocks;
+        while (high - low > 1) {
+            uint64_t middle = (low + high) / 2;
+            if (block_first_name(dir, middle) <= name) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+    string block_first_name(IndexDirectory const& dir, uint64_t block) {
+        const char* in = names + restarts[dir.first_restart + block];
+        uint64_t shared;
+        uint64_t suffix;
+        in = get_varint(in, shared);
+        in = get_varint(in, suffix);
+        return string(in, suffix);
+    }
+
+    MappedFile file;
+    const char* mapping = nullptr;
+    IndexHeader const* header = nullptr;
+    IndexDirectory const* directories = nullptr;
+    const char* directory_names = nullptr;
+    uint64_t const* inodes = nullptr;
+    int64_t const* sizes = nullptr;
+    uint32_t const* nlinks = nullptr;
+    int64_t const* mtimes = nullptr;
+    uint8_t const* types = nullptr;
+    uint64_t const* restarts = nullptr;
+    const char* names = nullptr;
+};
+
+class IndexBuilder {
+public:
+    // previous is the index being refreshed, or nullptr for a full build
+    explicit IndexBuilder(IndexReader const* previous) : previous(previous), build_start_ns(wall_clock_ns()) {
+        if (previous != nullptr) {
+            previous->list_children(previous_children);
+        }
+    }
+
+    // Adds the directory open_name inside parent_fd and everything under it.
+    // previous_index is the same directory in the previous index, or NO_DIRECTORY.
+    // Returns false if the directory itself could not be read.
+    bool directory(int parent_fd, const char* open_name, string const& path,
+                   uint64_t parent, string const& name, uint64_t previous_index) {
+        struct stat dir_stats{};
+        FileDescriptor dir_fd;
+        if (previous_index == NO_DIRECTORY) {
+            dir_fd = open_directory(parent_fd, open_name);
+            if (!dir_fd.valid() || sys_fstat(dir_fd.get(), &dir_stats) == -1) {
+                cerr << "Error reading contents of " << path << endl;
+                print_error();
+                return false;
+            }
+        } else {
+            // an unchanged directory is never opened for reading, O_PATH is enough to check it
+            FileDescriptor handle = open_path(parent_fd, open_name);
+            if (!handle.valid() || sys_fstat(handle.get(), &dir_stats) == -1) {
+                cerr << "Error reading contents of " << path << endl;
+                print_error();
+                return false;
+            }
+            if (!S_ISDIR(dir_stats.st_mode)) {
+                return false;
+            }
+            if (unchanged(previous->directories[previous_index], dir_stats)) {
+                reuse(handle.get(), path, parent, name, previous_index);
+                return true;
+            }
+            dir_fd = open_directory(handle.get(), ".");
+            if (!dir_fd.valid()) {
+                cerr << "Error reading contents of " << path << endl;
+                print_error();
+                return false;
+            }
+        }
+
+        uint64_t index = add_directory(parent, name, dir_stats);
+        rescanned++;
+        bump(traversal_counters.directories);
+        if (progress_enabled()) {
+            set_current_directory(path);
+        }
+
+        std::vector<ListedEntry> entries;
+        if (!list_directory(dir_fd.get(), entries)) {
+            cerr << "Error reading contents of " << path << endl;
+            print_error();
+            return false;
+        }
+        std::sort(entries.begin(), entries.end(), [](ListedEntry const& a, ListedEntry const& b) {
+            return a.name < b.name;
+        });
+
+        std::vector<ListedEntry const*> subdirectories;
+        string previous_name;
+        uint32_t count = 0;
+        for (auto const& entry : entries) {
+            bump(traversal_counters.entries);
+            if (entry.type == DT_DIR) {
+                subdirectories.push_back(&entry);
+                continue;
+            }
+
+            struct stat stats{};
+            unsigned returned_mask = 0;
+            if (stat_entry(dir_fd.get(), entry.name.c_str(), STATX_TYPE | INDEXED_STATS, &stats, returned_mask) == -1) {
+                cerr << "Error reading stats of file at " << path << entry.name << endl;
+                print_error();
+                continue;
+            }
+            if (S_ISDIR(stats.st_mode)) {
+                // DT_UNKNOWN that turned out to be a directory
+                subdirectories.push_back(&entry);
+                continue;
+            }
+
+            if (count % RESTART_INTERVAL == 0) {
+                restarts.push_back(names.size());
+                previous_name.clear();
+            }
+            size_t shared = shared_prefix(previous_name, entry.name);
+            put_varint(names, shared);
+            put_varint(names, entry.name.size() - shared);
+            names.insert(names.end(), entry.name.begin() + shared, entry.name.end());
+            previous_name = entry.name;
+            count++;
+
+            inodes.push_back(entry.ino);
+            sizes.push_back(stats.st_size);
+            nlinks.push_back(static_cast<uint32_t>(stats.st_nlink));
+            mtimes.push_back(to_ns(stats.st_mtim));
+            types.push_back(static_cast<uint8_t>(IFTODT(stats.st_mode)));
+        }
+        directories[index].entry_count = count;
+
+        for (auto entry : subdirectories) {
+            uint64_t previous_child = previous_index == NO_DIRECTORY ? NO_DIRECTORY
+                                                                     : find_child(previous_index, entry->name);
+            directory(dir_fd.get(), entry->name.c_str(), path + entry->name + "/", index, entry->name,
+                      previous_child);
+        }
+        return true;
+    }
+
+    void print_summary() const {
+        if (previous != nullptr && stats_enabled()) {
+            cerr << rescanned << " directories read, " << reused << " reused from the previous index" << endl;
+        }
+    }
+
+    bool write(string const& db_path, string const& root) {
+        IndexHeader header{};
+        memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        header.version = INDEX_VERSION;
+        header.restart_interval = RESTART_INTERVAL;
+        header.directory_count = directories.size();
+        header.entry_count = inodes.size();
+        header.restart_count = restarts.size();
+
+        SectionWriter writer;
+        if (!writer.open(db_path)) {
+            return false;
+        }
+        // the header is rewritten with the final offsets by commit()
+        writer.section(&header, sizeof(header));
+        header.root_offset = writer.section(root.data(), root.size());
+        header.root_length = root.size();
+        header.directories_offset = writer.section(directories.data(), directories.size() * sizeof(IndexDirectory));
+        header.directory_names_offset = writer.section(directory_names.data(), directory_names.size());
+        header.directory_names_size = directory_names.size();
+        header.inodes_offset = writer.section(inodes.data(), inodes.size() * sizeof(uint64_t));
+        header.sizes_offset = writer.section(sizes.data(), sizes.size() * sizeof(int64_t));
+        header.nlinks_offset = writer.section(nlinks.data(), nlinks.size() * sizeof(uint32_t));
+        header.mtimes_offset = writer.section(mtimes.data(), mtimes.size() * sizeof(int64_t));
+        header.types_offset = writer.section(types.data(), types.size());
+        header.restarts_offset = writer.section(restarts.data(), restarts.size() * sizeof(uint64_t));
+        header.names_offset = writer.section(names.data(), names.size());
+        header.names_size = names.size();
+        header.file_size = writer.size();
+        return writer.commit(&header, sizeof(header));
+    }
+
+private:
+    static int64_t wall_clock_ns() {
+        timespec now{};
+        clock_gettime(CLOCK_REALTIME, &now);
+        return to_ns(now);
+    }
+
+    uint64_t add_directory(uint64_t parent, string const& name, struct stat const& dir_stats) {
+        int64_t mtime = to_ns(dir_stats.st_mtim);
+        int64_t ctime = to_ns(dir_stats.st_ctim);
+        // A change within the timestamp granularity of the build may leave mtime as it is,
+        // so such directories are marked to be read again by the next refresh.
+        if (mtime >= build_start_ns - 1000000000 || ctime >= build_start_ns - 1000000000) {
+            mtime = UNSTABLE_TIME;
+        }
+        directories.push_back(IndexDirectory{parent, inodes.size(), restarts.size(), directory_names.size(),
+                                             static_cast<uint64_t>(dir_stats.st_dev), dir_stats.st_ino,
+                                             mtime, ctime, 0, static_cast<uint32_t>(name.size())});
+        directory_names.insert(directory_names.end(), name.begin(), name.end());
+        return directories.size() - 1;
+    }
+
+    static bool unchanged(IndexDirectory const& old, struct stat const& dir_stats) {
+        return old.mtime != UNSTABLE_TIME &&
+               old.dev == static_cast<uint64_t>(dir_stats.st_dev) &&
+               old.ino == dir_stats.st_ino &&
+               old.mtime == to_ns(dir_stats.st_mtim) &&
+               old.ctime == to_ns(dir_stats.st_ctim);
+    }
+
+    // Copies the entries of an unchanged directory from the previous index
+    // and goes on checking its subdirectories
+    void reuse(int handle, string const& path, uint64_t parent, string const& name, uint64_t previous_index) {
+        IndexDirectory const& old = previous->directories[previous_index];
+        IndexDirectory copy = old;
+        copy.parent = parent;
+        copy.first_entry = inodes.size();
+        copy.first_restart = restarts.size();
+        copy.name_offset = directory_names.size();
+        directories.push_back(copy);
+        directory_names.insert(directory_names.end(), name.begin(), name.end());
+        uint64_t index = directories.size() - 1;
+        reused++;
+        bump(traversal_counters.directories);
+
+        uint64_t first = old.first_entry;
+        uint64_t last = old.first_entry + old.entry_count;
+        inodes.insert(inodes.end(), previous->inodes + first, previous->inodes + last);
+        sizes.insert(sizes.end(), previous->sizes + first, previous->sizes + last);
+        nlinks.insert(nlinks.end(), previous->nlinks + first, previous->nlinks + last);
+        mtimes.insert(mtimes.end(), previous->mtimes + first, previous->mtimes + last);
+        types.insert(types.end(), previous->types + first, previous->types + last);
+
+        // the front coded names are copied as they are, only their restarts move
+        uint64_t blocks = (old.entry_count + RESTART_INTERVAL - 1) / RESTART_INTERVAL;
+        if (blocks > 0) {
+            uint64_t begin = previous->restarts[old.first_restart];
+            uint64_t end = old.first_restart + blocks < previous->header->restart_count
+                           ? previous->restarts[old.first_restart + blocks]
+                           : previous->header->names_size;
+            for (uint64_t r = old.first_restart; r < old.first_restart + blocks; r++) {
+                restarts.push_back(previous->restarts[r] - begin + names.size());
+            }
+            names.insert(names.end(), previous->names + begin, previous->names + end);
+        }
+
+        for (uint64_t child : previous_children[previous_index]) {
+            string child_name = previous->directory_name(child);
+            directory(handle, child_name.c_str(), path + child_name + "/", index, child_name, child);
+        }
+    }
+
+    uint64_t find_child(uint64_t previous_index, string const& name) const {
+        auto const& children = previous_children[previous_index];
+        auto found = std::lower_bound(children.begin(), children.end(), name,
+                                      [this](uint64_t child, string const& value) {
+                                          return previous->directory_name(child) < value;
+                                      });
+        if (found != children.end() && previous->directory_name(*found) == name) {
+            return *found;
+        }
+        return NO_DIRECTORY;
+    }
+
+    IndexReader const* previous;
+    std::vector<std::vector<uint64_t>> previous_children;
+    int64_t build_start_ns;
+    uint64_t rescanned = 0;
+    uint64_t reused = 0;
+
+    std::vector<IndexDirectory> directories;
+    std::vector<char> directory_names;
+    std::vector<uint64_t> inodes;
+    std::vector<int64_t> sizes;
+    std::vector<uint32_t> nlinks;
+    std::vector<int64_t> mtimes;
+    std::vector<uint8_t> types;
+    std::vector<uint64_t> restarts;
+    std::vector<char> names;
+};
+
+} // namespace
+
+bool build_index(string const& db_path, string const& root) {
+    IndexBuilder builder(nullptr);
+    // an unreadable root would leave an empty index in place of the old one
+    if (!builder.directory(AT_FDCWD, root.c_str(), root, NO_PARENT, "", NO_DIRECTORY)) {
+        return false;
+    }
+    return builder.write(db_path, root);
+}
+
+bool refresh_index(string const& db_path) {
+    IndexReader previous;
+    if (!previous.open(db_path)) {
+        return false;
+    }
+    string root = previous.root();
+    IndexBuilder builder(&previous);
+    if (!builder.directory(AT_FDCWD, root.c_str(), root, NO_PARENT, "", 0)) {
+        return false;
+    }
+    builder.print_summary();
+    return builder.write(db_path, root);
+}
+
+bool query_index(string const& db_path, string const& prefix, MatchCallback on_match) {
+    IndexReader reader;
+    if (!reader.open(db_path)) {
+        return false;
+    }
+    reader.query(prefix, on_match);
+    return true;
+}
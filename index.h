@@ -0,0 +1,29 @@
+#ifndef OS_FIND_INDEX_H
+#define OS_FIND_INDEX_H
+
+#include <string>
+
+#include "entry.h"
+
+// Called for every indexed entry that satisfies the predicates
+typedef void (*MatchCallback)(std::string const& dir_path, const char* name, EntryInfo const& info);
+
+// Walks the tree under root (an absolute path ending with '/') and writes its index to db_path.
+// Every directory is stored with its dev, inode, mtime and ctime.
+// The index is written in native byte order and is meant to be mmap-ed as is:
+// a header, the directory table in preorder, the names of the directories,
+// the inode, size, hardlinks, mtime and type columns of all other entries, and their names.
+// Entries of a directory are contiguous and sorted by name; names are front coded
+// (shared prefix length, suffix) and restart from an empty prefix every RESTART_INTERVAL
+// entries, so that a name can be found by binary search over the restarts.
+bool build_index(std::string const& db_path, std::string const& root);
+
+// Rebuilds the index at db_path, reading again only the directories whose identity changed.
+// Entries of unchanged directories, subdirectory names included, are copied from the old index;
+// their own stats are not refreshed, since changing a file does not change its directory.
+bool refresh_index(std::string const& db_path);
+
+// Answers the predicates from the index. Only entries under prefix are reported.
+bool query_index(std::string const& db_path, std::string const& prefix, MatchCallback on_match);
+
+#endif //OS_FIND_INDEX_H
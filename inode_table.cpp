@@ -0,0 +1,61 @@
+#include "inode_table.h"
+
+namespace {
+
+const size_t INITIAL_SLOTS = 1024;
+
+// the finalizer of splitmix64, as inode numbers are often dense
+uint64_t mix(uint64_t dev, uint64_t ino) {
+    uint64_t hash = ino ^ (dev << 32 | dev >> 32);
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+} // namespace
+
+uint32_t InodeTable::insert(uint64_t dev, uint64_t ino, uint32_t value, bool& inserted) {
+    // at most half full, so that probe sequences stay short
+    if (2 * (count + 1) > slots.size()) {
+        grow();
+    }
+    size_t mask = slots.size() - 1;
+    for (size_t i = mix(dev, ino) & mask;; i = (i + 1) & mask) {
+        Slot& slot = slots[i];
+        if (!slot.used) {
+            slot = Slot{dev, ino, value, 1};
+            count++;
+            inserted = true;
+            return value;
+        }
+        if (slot.dev == dev && slot.ino == ino) {
+            inserted = false;
+            return slot.value;
+        }
+    }
+}
+
+void InodeTable::clear() {
+    slots.clear();
+    count = 0;
+}
+
+void InodeTable::grow() {
+    std::vector<Slot> old;
+    old.swap(slots);
+    slots.resize(old.empty() ? INITIAL_SLOTS : 2 * old.size());
+    size_t mask = slots.size() - 1;
+    for (auto const& slot : old) {
+        if (!slot.used) {
+            continue;
+        }
+        size_t i = mix(slot.dev, slot.ino) & mask;
+        while (slots[i].used) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef OS_FIND_INODE_TABLE_H
+#define OS_FIND_INODE_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hash table from (dev, ino) to a number, with open addressing: 24 bytes per slot and
+// no allocation per entry. Only files with several links are meant to go in, so it
+// stays small even on huge trees. Not thread-safe.
+class InodeTable {
+public:
+    // Returns the value of the key. A new key gets value, and inserted is set.
+    uint32_t insert(uint64_t dev, uint64_t ino, uint32_t value, bool& inserted);
+
+    size_t size() const { return count; }
+    void clear();
+
+private:
+    struct Slot {
+        uint64_t dev;
+        uint64_t ino;
+        uint32_t value;
+        uint32_t used;
+    };
+
+    void grow();
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+};
+
+#endif //OS_FIND_INODE_TABLE_H
@@ -0,0 +1,63 @@
+#include "links.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "inode_table.h"
+#include "output.h"
+
+bool group_links = false;
+
+namespace {
+
+struct LinkedPath {
+    uint32_t group;
+    std::string path;
+    uint32_t dir_length;
+    EntryInfo info;
+};
+
+InodeTable groups;
+std::vector<LinkedPath> linked;
+
+} // namespace
+
+void add_linked_path(std::string const& dir_path, const char* name, EntryInfo const& info) {
+    if (info.stats.st_nlink < 2) {
+        return;
+    }
+    bool inserted;
+    auto group = groups.insert(info.stats.st_dev, info.stats.st_ino, static_cast<uint32_t>(groups.size()), inserted);
+    linked.push_back(LinkedPath{group, dir_path + name, static_cast<uint32_t>(dir_path.size()), info});
+}
+
+void report_link_groups() {
+    std::sort(linked.begin(), linked.end(), [](LinkedPath const& a, LinkedPath const& b) {
+        return a.group < b.group || (a.group == b.group && a.path < b.path);
+    });
+    // [begin, end) of every group, ordered by the first path of the group
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t start = 0; start < linked.size();) {
+        size_t end = start + 1;
+        while (end < linked.size() && linked[end].group == linked[start].group) {
+            end++;
+        }
+        ranges.emplace_back(start, end);
+        start = end;
+    }
+    std::sort(ranges.begin(), ranges.end(), [](std::pair<size_t, size_t> const& a, std::pair<size_t, size_t> const& b) {
+        return linked[a.first].path < linked[b.first].path;
+    });
+
+    for (auto const& range : ranges) {
+        for (size_t i = range.first; i < range.second; i++) {
+            LinkedPath const& link = linked[i];
+            std::string dir_path = link.path.substr(0, link.dir_length);
+            emit(dir_path, link.path.c_str() + link.dir_length, link.info);
+        }
+        emit_group_end();
+    }
+    linked.clear();
+    groups.clear();
+}
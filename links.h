@@ -0,0 +1,20 @@
+#ifndef OS_FIND_LINKS_H
+#define OS_FIND_LINKS_H
+
+#include <string>
+
+#include "entry.h"
+
+// -group-links: instead of the matches, output the paths of every matched inode that
+// has several links, grouped by inode
+extern bool group_links;
+
+// Takes a matched file, with its stats; files with a single link are dropped.
+// Not thread-safe, the caller serializes the calls.
+void add_linked_path(std::string const& dir_path, const char* name, EntryInfo const& info);
+
+// Outputs each group as its paths in order followed by an empty record, the groups
+// ordered by their first path
+void report_link_groups();
+
+#endif //OS_FIND_LINKS_H
@@ -7,105 +7,267 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <cstring>
-#include <cassert>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <mutex>
+#include <sstream>
 #include <vector>
 
+#include "checkpoint.h"
+#include "checksum.h"
+#include "contents.h"
+#include "daemon.h"
+#include "dircache.h"
+#include "duplicates.h"
+#include "directory.h"
+#include "entry.h"
+#include "fd.h"
+#include "index.h"
+#include "links.h"
+#include "output.h"
+#include "parallel.h"
+#include "predicates.h"
+#include "progress.h"
+#include "roots.h"
+#include "sorter.h"
+#include "stats.h"
+#include "trace.h"
+#include "top.h"
+#include "trigram.h"
+#include "usage.h"
+
 using std::cerr;
 using std::cout;
 using std::endl;
 using std::string;
 
-enum class SizeMode {
-    NONE,
-    LESS,
-    EQUAL,
-    GREATER
-};
-
-struct linux_dirent64 {
-    ino64_t d_ino;
-    off64_t d_off;
-    unsigned short d_reclen;
-    unsigned char d_type;
-    char d_name[];
-};
-
 const int BUFFER_SIZE = 1024;
 
-ino64_t inode_target;
-string name_target;
+std::vector<string> roots;
+std::mutex results_mutex;
 std::vector<string> results;
-SizeMode size_mode;
-off_t size_target;
-nlink_t nlinks_target;
+// -sort when the results do not arrive in order and go through the sorter
+bool collect_sorted = false;
 string exec_target;
-
-void print_error() {
-    assert(errno != 0);
-    cerr << strerror(errno) << endl;
-}
+string build_index_path;
+string index_path;
+string refresh_index_path;
+string build_trigram_index_path;
+string trigram_index_path;
+string daemon_socket_path;
+string client_socket_path;
+string resume_path;
 
 // returns false if reading file info failed
-bool matches(linux_dirent64* entry, int dir_fd, string const& dir_path) {
-    if (inode_target != 0 &&
-        entry->d_ino != inode_target) {
-            return false;
-    }
+// fills info with everything learned about the entry on the way
+bool matches(ino64_t ino, unsigned char type, const char* name, int dir_fd, string const& dir_path,
+             EntryInfo& info) {
+    info.ino = ino;
+    info.type = type;
+    info.stats_mask = 0;
 
-    if (!name_target.empty() &&
-        std::string(entry->d_name) != name_target) {
+    if (!matches_dirent(ino, name)) {
         return false;
     }
 
     // do not call stat if we don't have to
-    if (size_mode == SizeMode::NONE && nlinks_target == 0) {
+    if (!predicates_need_stats() && !output_needs_stats() && !find_duplicates && !top_enabled() && !group_links) {
         return true;
     }
 
-    int fd = openat(dir_fd, entry->d_name, O_RDONLY);
-    if (fd == -1) {
-        cerr << "Error opening file at " << dir_path << entry->d_name << endl;
+    // the predicates alone only need some fields, which is cheaper to get on network file systems
+    unsigned mask = output_needs_stats() || find_duplicates || top_enabled() || group_links
+                    ? STATX_BASIC_STATS : predicates_statx_mask();
+    uint64_t stat_start = trace_enabled() ? now_ns() : 0;
+    struct stat& stats = info.stats;
+    if (stat_entry(dir_fd, name, mask, &stats, info.stats_mask) == -1) {
+        cerr << "Error reading stats of file at " << dir_path << name << endl;
         print_error();
         return false;
     }
+    if (trace_enabled()) {
+        record_slow(SlowKind::STAT, dir_path + name, 0, stat_start, now_ns() - stat_start);
+    }
+
+    return matches_stats(stats);
+}
+
+// Passes a match on to wherever the results go. Called with results_mutex held,
+// except for -top, which keeps a heap per thread.
+void deliver_match(string const& dir_path, const char* name, EntryInfo const& info) {
+    if (top_enabled()) {
+        top_add(dir_path, name, info);
+    } else if (!exec_target.empty()) {
+        results.push_back(dir_path + name);
+    } else if (find_duplicates) {
+        add_duplicate_candidate(dir_path, name, info);
+    } else if (group_links) {
+        add_linked_path(dir_path, name, info);
+    } else if (collect_sorted) {
+        sort_add(dir_path, name, info);
+    } else if (hashing()) {
+        add_hash_target(dir_path, name, info);
+    } else {
+        emit(dir_path, name, info);
+    }
+    bump(traversal_counters.matches);
+}
+
+// Where the files chosen by -top go once they are known
+void deliver_top(string const& dir_path, const char* name, EntryInfo const& info) {
+    if (!exec_target.empty()) {
+        results.push_back(dir_path + name);
+    } else if (hashing()) {
+        add_hash_target(dir_path, name, info);
+    } else {
+        emit(dir_path, name, info);
+    }
+}
+
+void deliver_locked(string const& dir_path, const char* name, EntryInfo const& info) {
+    std::lock_guard<std::mutex> guard(results_mutex);
+    deliver_match(dir_path, name, info);
+}
+
+void report_match(string const& dir_path, const char* name, EntryInfo const& info) {
+    // the files are read outside results_mutex, so that the other roots go on walking
+    if (contents_enabled()) {
+        add_contents_candidate(dir_path, name, info, deliver_locked);
+    } else if (top_enabled()) {
+        deliver_match(dir_path, name, info);
+    } else {
+        deliver_locked(dir_path, name, info);
+    }
+}
+
+void visit(int dir_fd, string const& path, uint64_t open_start_ns, uint64_t open_ns);
+
+void visit_entry(int dir_fd, string const& path, const char* name, ino64_t ino, unsigned char type,
+                 EntryInfo& info) {
+    // some file systems leave the type out of the dirent
+    if (type == DT_UNKNOWN) {
+        type = entry_type(dir_fd, name);
+    }
+    if (disk_usage && type != DT_DIR) {
+        count_usage(dir_fd, path, name);
+    } else if (type_wanted(type) && matches(ino, type, name, dir_fd, path, info)) {
+        report_match(path, name, info);
+    }
+    if (type == DT_DIR) {
+        uint64_t open_start = trace_enabled() ? now_ns() : 0;
+        FileDescriptor fd = open_directory(dir_fd, name);
+        if (!fd.valid()) {
+            cerr << "Error reading contents of " << path  << name << "/" << endl;
+            print_error();
+        } else {
+            uint64_t open_ns = trace_enabled() ? now_ns() - open_start : 0;
+            visit(fd.get(), path + name + "/", open_start, open_ns);
+        }
+    }
+    if (checkpoint_enabled()) {
+        entry_done(path, name);
+    }
+}
 
-    struct stat stats{};
-    int result = fstat(fd, &stats);
-    if (result == -1) {
-        cerr << "Error reading stats of file at " << dir_path << entry->d_name << endl;
+// Continues a directory on the path to the entry of a checkpoint: the entries before it
+// were handled by the interrupted run, the directory it is in is continued the same way.
+void visit_resumed(int dir_fd, string const& path, std::vector<string> const& resume, size_t depth) {
+    bump(traversal_counters.directories);
+    std::vector<ListedEntry> entries;
+    if (!list_directory(dir_fd, entries)) {
+        cerr << "Error reading contents of " << path << endl;
         print_error();
-        return false;
+        return;
+    }
+    // the entry on the path to the checkpoint has to be known to be a directory
+    resolve_types(dir_fd, entries);
+    if (sort_output) {
+        std::sort(entries.begin(), entries.end(), listed_path_less);
     }
 
-    if (size_mode != SizeMode::NONE) {
-        switch (size_mode) {
-            case SizeMode::LESS:
-                if (stats.st_size > size_target) { return false; }
-                break;
-            case SizeMode::EQUAL:
-                if (stats.st_size != size_target) { return false; }
-                break;
-            case SizeMode::GREATER:
-                if (stats.st_size < size_target) { return false; }
-                break;
-            case SizeMode::NONE:
-                assert(false);
+    auto next = std::find_if(entries.begin(), entries.end(), [&](ListedEntry const& entry) {
+        return entry.name == resume[depth];
+    });
+    if (next == entries.end()) {
+        cerr << path << " changed since the checkpoint, its results may repeat" << endl;
+        next = entries.begin();
+    } else {
+        if (depth + 1 < resume.size() && next->type == DT_DIR) {
+            FileDescriptor fd = open_directory(dir_fd, next->name.c_str());
+            if (!fd.valid()) {
+                cerr << "Error reading contents of " << path << next->name << "/" << endl;
+                print_error();
+            } else {
+                visit_resumed(fd.get(), path + next->name + "/", resume, depth + 1);
+            }
         }
+        ++next;
     }
 
-    if (nlinks_target != 0 &&
-        nlinks_target != stats.st_nlink) {
-        return false;
+    EntryInfo info;
+    for (; next != entries.end(); ++next) {
+        bump(traversal_counters.entries);
+        visit_entry(dir_fd, path, next->name.c_str(), next->ino, next->type, info);
     }
+}
 
-    return true;
+// Reads the whole listing before visiting the entries, for the directory cache and -sort.
+// The listing comes from the directory cache when the directory did not change,
+// otherwise it is read and stored into the cache.
+void visit_listed(int dir_fd, string const& path, uint64_t open_start_ns, uint64_t open_ns) {
+    uint64_t read_start = trace_enabled() ? now_ns() : 0;
+    struct statx identity{};
+    bool identified = dir_cache_enabled() && directory_identity(dir_fd, identity);
+    std::vector<ListedEntry> entries;
+    if (!identified || !cached_listing(identity, entries)) {
+        if (!list_directory(dir_fd, entries)) {
+            cerr << "Error reading contents of " << path << endl;
+            print_error();
+            return;
+        }
+        if (identified) {
+            store_listing(identity, entries);
+        }
+    }
+    if (sort_output) {
+        resolve_types(dir_fd, entries);
+        std::sort(entries.begin(), entries.end(), listed_path_less);
+    }
+    if (trace_enabled()) {
+        record_slow(SlowKind::DIRECTORY, path, entries.size(), open_start_ns, open_ns + now_ns() - read_start);
+    }
+
+    EntryInfo info;
+    for (auto const& entry : entries) {
+        bump(traversal_counters.entries);
+        visit_entry(dir_fd, path, entry.name.c_str(), entry.ino, entry.type, info);
+    }
 }
 
-void visit(int dir_fd, string const& path) {
+// open_start_ns and open_ns describe the openat of the directory, for -trace-slow
+void visit(int dir_fd, string const& path, uint64_t open_start_ns, uint64_t open_ns) {
+    bump(traversal_counters.directories);
+    if (progress_enabled()) {
+        set_current_directory(path);
+    }
+    UsageScope usage(dir_fd, path);
+    if (dir_cache_enabled() || sort_output) {
+        visit_listed(dir_fd, path, open_start_ns, open_ns);
+        return;
+    }
+
     char buf[BUFFER_SIZE];
+    uint64_t read_ns = open_ns;
+    uint64_t entries = 0;
+    EntryInfo info;
 
     while (true) {
-        long read = syscall(SYS_getdents64, dir_fd, buf, BUFFER_SIZE);
+        uint64_t read_start = trace_enabled() ? now_ns() : 0;
+        long read = sys_getdents64(dir_fd, buf, BUFFER_SIZE);
+        if (trace_enabled()) {
+            read_ns += now_ns() - read_start;
+        }
 
         if (read == -1) {
             cerr << "Error reading contents of " << path << endl;
@@ -113,8 +275,12 @@ void visit(int dir_fd, string const& path) {
             return;
         }
         if (read == 0) {
+            if (trace_enabled()) {
+                record_slow(SlowKind::DIRECTORY, path, entries, open_start_ns, read_ns);
+            }
             return;
         }
+        run_stats.dirent_bytes += read;
 
         for (char* ptr = buf; ptr < buf + read;) {
             auto entry = reinterpret_cast<linux_dirent64*>(ptr);
@@ -124,34 +290,91 @@ void visit(int dir_fd, string const& path) {
                 ptr += entry->d_reclen;
                 continue;
             }
+            bump(traversal_counters.entries);
+            entries++;
 
-            if (entry->d_type == DT_REG && matches(entry, dir_fd, path)) {
-                results.push_back(path + entry->d_name);
-            } else if (entry->d_type == DT_DIR) {
-                int fd = openat(dir_fd, entry->d_name, O_RDONLY | O_DIRECTORY);
-                if (fd == -1) {
-                    cerr << "Error reading contents of " << path  << name << "/" << endl;
-                    print_error();
-                } else {
-                    visit(fd, path + name + "/");
-                    close(fd);
-                }
-            }
+            visit_entry(dir_fd, path, entry->d_name, entry->d_ino, entry->d_type, info);
             ptr += entry->d_reclen;
         }
     }
 }
 
+// resume is the entry of a checkpoint to continue from, empty for a full walk
+void walk_root(string const& root, std::vector<string> const& resume) {
+    string path = root;
+    if (path.back() != '/') { path += '/'; }
+    uint64_t open_start = trace_enabled() ? now_ns() : 0;
+    FileDescriptor fd = open_directory(AT_FDCWD, path.c_str());
+    if (!fd.valid()) {
+        cerr << "Error reading contents of " << path << endl;
+        print_error();
+        return;
+    }
+    uint64_t open_ns = trace_enabled() ? now_ns() - open_start : 0;
+    if (resume.empty()) {
+        visit(fd.get(), path, open_start, open_ns);
+    } else {
+        visit_resumed(fd.get(), path, resume, 0);
+    }
+}
+
+// Several roots are walked in parallel, all of them reporting to the same output
+void walk_roots(std::vector<string> const& walked) {
+    parallel_for(walked.size(), [&walked](size_t i) {
+        walk_root(walked[i], {});
+    });
+}
+
+// The options given without a value, every other argument starting with '-' takes one
+const char* const SWITCHES[] = {
+    "--stats", "--stats-json", "-duplicates", "-duplicates-sha1", "-du", "-du-bytes", "-size-rounded",
+    "-unique-inode", "-group-links", "-sort", "-print0", "-json", "-csv",
+};
+
+bool takes_value(string const& arg) {
+    return arg[0] == '-' && std::find(std::begin(SWITCHES), std::end(SWITCHES), arg) == std::end(SWITCHES);
+}
+
 void error_multiple_specified(const string &s) {
     cout << "Only one " << s << " can be specified" << endl;
 }
 
 int set_args(int argc, char* argv[]) {
+    bool top_key_given = false;
+    bool trace_output_given = false;
     bool hasDir = false;
     int dirPosition = 0;
 
     for (int i = 1; i < argc;) {
-        if (argv[i][0] == '-') {
+        auto flag = string(argv[i]);
+        if (flag == "--stats" || flag == "--stats-json") {
+            stats_mode = flag == "--stats" ? StatsMode::TEXT : StatsMode::JSON;
+            i++;
+        } else if (flag == "-duplicates" || flag == "-duplicates-sha1") {
+            find_duplicates = true;
+            confirm_sha1 = confirm_sha1 || flag == "-duplicates-sha1";
+            i++;
+        } else if (flag == "-du" || flag == "-du-bytes") {
+            disk_usage = true;
+            usage_in_bytes = usage_in_bytes || flag == "-du-bytes";
+            i++;
+        } else if (flag == "-size-rounded") {
+            size_rounded = true;
+            i++;
+        } else if (flag == "-unique-inode") {
+            unique_inode = true;
+            i++;
+        } else if (flag == "-group-links") {
+            group_links = true;
+            i++;
+        } else if (flag == "-sort") {
+            sort_output = true;
+            i++;
+        } else if (flag == "-print0" || flag == "-json" || flag == "-csv") {
+            output_format = flag == "-print0" ? OutputFormat::PRINT0
+                          : flag == "-json" ? OutputFormat::JSON : OutputFormat::CSV;
+            i++;
+        } else if (takes_value(flag)) {
             if (argc < i + 2) {
                 cout << "Option " << argv[i] << " is missing its value";
                 return -1;
@@ -174,34 +397,71 @@ int set_args(int argc, char* argv[]) {
                     error_multiple_specified("file name");
                     return -1;
                 }
-                name_target = argv[i + 1];
+                set_name_target(argv[i + 1]);
             } else if (option == "-size") {
-                if (size_mode != SizeMode::NONE) {
-                    error_multiple_specified("file size");
-                    return -1;
-                }
-                bool mode_specified = true;
-                switch (argv[i+1][0]) {
-                    case '-':
-                        size_mode = SizeMode::LESS;
-                        break;
-                    case '=':
-                        size_mode = SizeMode::EQUAL;
-                        break;
-                    case '+':
-                        size_mode = SizeMode::GREATER;
-                        break;
-                    default:
-                        mode_specified = false;
-                        break;
+                if (size_condition_count == MAX_SIZE_CONDITIONS) {
+                    cout << "At most " << MAX_SIZE_CONDITIONS << " file sizes can be specified" << endl;
+                    return -1;
                 }
-
-                try {
-                    size_target = std::stoi(argv[i+1] + (mode_specified ? 1 : 0));
-                } catch (std::logic_error& error) {
+                if (!add_size_condition(argv[i + 1])) {
                     cout << "Bad -size argument" << endl;
                     return -1;
                 }
+            } else if (option == "-contains") {
+                if (contents_enabled()) {
+                    error_multiple_specified("contained string");
+                    return -1;
+                }
+                contents_target = argv[i + 1];
+                if (contents_target.empty()) {
+                    cout << "Bad -contains argument" << endl;
+                    return -1;
+                }
+            } else if (option == "-atime" || option == "-ctime" || option == "-mtime" ||
+                       option == "-amin" || option == "-cmin" || option == "-mmin") {
+                if (!add_time_condition(option, argv[i + 1])) {
+                    cout << "Bad " << option << " argument" << endl;
+                    return -1;
+                }
+            } else if (option == "-newer") {
+                if (!add_newer_condition(argv[i + 1])) {
+                    cout << "Can not read the modification time of " << argv[i + 1] << endl;
+                    return -1;
+                }
+            } else if (option == "-uid" || option == "-user") {
+                if (uid_target != NO_UID) {
+                    error_multiple_specified("owner");
+                    return -1;
+                }
+                bool parsed = option == "-user" ? set_user_target(argv[i + 1]) : set_uid_target(argv[i + 1]);
+                if (!parsed) {
+                    cout << "Bad " << option << " argument" << endl;
+                    return -1;
+                }
+            } else if (option == "-gid" || option == "-group") {
+                if (gid_target != NO_GID) {
+                    error_multiple_specified("group");
+                    return -1;
+                }
+                bool parsed = option == "-group" ? set_group_target(argv[i + 1]) : set_gid_target(argv[i + 1]);
+                if (!parsed) {
+                    cout << "Bad " << option << " argument" << endl;
+                    return -1;
+                }
+            } else if (option == "-perm") {
+                if (perm_mode != PermMode::NONE) {
+                    error_multiple_specified("permission mode");
+                    return -1;
+                }
+                if (!set_perm_target(argv[i + 1])) {
+                    cout << "Bad -perm argument" << endl;
+                    return -1;
+                }
+            } else if (option == "-type") {
+                if (!add_type_targets(argv[i + 1])) {
+                    cout << "Bad -type argument, expected letters of f, d, l, s, p, b, c separated by commas" << endl;
+                    return -1;
+                }
             } else if (option == "-nlinks") {
                 if (nlinks_target != 0) {
                     error_multiple_specified("hardlinks number");
@@ -213,6 +473,137 @@ int set_args(int argc, char* argv[]) {
                     cout << "Bad -nlinks argument" << endl;
                     return -1;
                 }
+            } else if (option == "-progress") {
+                if (progress_enabled()) {
+                    error_multiple_specified("progress interval");
+                    return -1;
+                }
+                try {
+                    progress_interval = std::stod(argv[i + 1]);
+                } catch (std::logic_error& error) {
+                    progress_interval = 0;
+                }
+                if (progress_interval <= 0) {
+                    cout << "Bad -progress argument" << endl;
+                    return -1;
+                }
+            } else if (option == "-trace-slow") {
+                if (trace_enabled()) {
+                    error_multiple_specified("trace threshold");
+                    return -1;
+                }
+                double threshold_ms = 0;
+                try {
+                    threshold_ms = std::stod(argv[i + 1]);
+                } catch (std::logic_error& error) {
+                    threshold_ms = 0;
+                }
+                if (threshold_ms <= 0) {
+                    cout << "Bad -trace-slow argument" << endl;
+                    return -1;
+                }
+                trace_threshold_ns = static_cast<uint64_t>(threshold_ms * 1e6);
+            } else if (option == "-trace-top") {
+                try {
+                    trace_top = std::stoul(argv[i + 1]);
+                } catch (std::logic_error& error) {
+                    cout << "Bad -trace-top argument" << endl;
+                    return -1;
+                }
+                trace_output_given = true;
+            } else if (option == "-trace-json") {
+                trace_json_path = argv[i + 1];
+                trace_output_given = true;
+            } else if (option == "-hash") {
+                if (hashing()) {
+                    error_multiple_specified("hash algorithm");
+                    return -1;
+                }
+                if (!parse_hash_algorithm(argv[i + 1])) {
+                    cout << "Bad -hash argument, expected sha1, sha256 or xxh64" << endl;
+                    return -1;
+                }
+            } else if (option == "-top") {
+                try {
+                    top_count = std::stoul(argv[i + 1]);
+                } catch (std::logic_error& error) {
+                    top_count = 0;
+                }
+                if (top_count == 0) {
+                    cout << "Bad -top argument" << endl;
+                    return -1;
+                }
+            } else if (option == "-by") {
+                if (!parse_top_key(argv[i + 1])) {
+                    cout << "Bad -by argument, expected size or mtime" << endl;
+                    return -1;
+                }
+                top_key_given = true;
+            } else if (option == "-du-top") {
+                try {
+                    usage_top = std::stoul(argv[i + 1]);
+                } catch (std::logic_error& error) {
+                    usage_top = 0;
+                }
+                if (usage_top == 0) {
+                    cout << "Bad -du-top argument" << endl;
+                    return -1;
+                }
+                disk_usage = true;
+            } else if (option == "-binary") {
+                if (!parse_binary_fields(argv[i + 1])) {
+                    cout << "Bad -binary argument" << endl;
+                    return -1;
+                }
+                output_format = OutputFormat::BINARY;
+            } else if (option == "-printf") {
+                if (!parse_printf_format(argv[i + 1])) {
+                    cout << "Bad -printf argument" << endl;
+                    return -1;
+                }
+                output_format = OutputFormat::PRINTF;
+            } else if (option == "--build-index" || option == "--index" || option == "--refresh-index" ||
+                       option == "--build-trigram-index" || option == "--trigram-index") {
+                if (!build_index_path.empty() || !index_path.empty() || !refresh_index_path.empty() ||
+                    !build_trigram_index_path.empty() || !trigram_index_path.empty()) {
+                    error_multiple_specified("index");
+                    return -1;
+                }
+                (option == "--index" ? index_path
+                 : option == "--build-index" ? build_index_path
+                 : option == "--refresh-index" ? refresh_index_path
+                 : option == "--trigram-index" ? trigram_index_path : build_trigram_index_path) = argv[i + 1];
+            } else if (option == "-sort-memory") {
+                size_t megabytes = 0;
+                try {
+                    megabytes = std::stoul(argv[i + 1]);
+                } catch (std::logic_error& error) {
+                    megabytes = 0;
+                }
+                if (megabytes == 0) {
+                    cout << "Bad -sort-memory argument" << endl;
+                    return -1;
+                }
+                sort_memory_budget = megabytes << 20;
+            } else if (option == "-dir-cache") {
+                if (dir_cache_enabled()) {
+                    error_multiple_specified("directory cache");
+                    return -1;
+                }
+                dir_cache_path = argv[i + 1];
+            } else if (option == "--daemon" || option == "--client") {
+                if (!daemon_socket_path.empty() || !client_socket_path.empty()) {
+                    error_multiple_specified("daemon socket");
+                    return -1;
+                }
+                (option == "--daemon" ? daemon_socket_path : client_socket_path) = argv[i + 1];
+            } else if (option == "-checkpoint" || option == "-resume") {
+                string& target = option == "-checkpoint" ? checkpoint_path : resume_path;
+                if (!target.empty()) {
+                    error_multiple_specified(option == "-checkpoint" ? "checkpoint file" : "resumed checkpoint");
+                    return -1;
+                }
+                target = argv[i + 1];
             } else if (option == "-exec") {
                 if (!exec_target.empty()) {
                     error_multiple_specified("execution target");
@@ -225,46 +616,401 @@ int set_args(int argc, char* argv[]) {
             }
             i+= 2;
         } else {
-            if (hasDir) {
-                error_multiple_specified("directory");
-                return -1;
+            if (!hasDir) {
+                dirPosition = i;
             }
             hasDir = true;
-            dirPosition = i;
+            roots.emplace_back(argv[i]);
             i++;
         }
     }
 
-    if (!hasDir) {
-        cout << "Usage: os_find [OPTIONS] DIRECTORY" << endl;
+    bool uses_index = !build_index_path.empty() || !index_path.empty() || !refresh_index_path.empty() ||
+                      !build_trigram_index_path.empty() || !trigram_index_path.empty();
+    if (uses_index && (!daemon_socket_path.empty() || !client_socket_path.empty())) {
+        cout << "Indexes can not be used with --daemon or --client" << endl;
+        return -1;
+    }
+
+    bool checkpoints = checkpoint_enabled() || !resume_path.empty();
+    if (checkpoints && (uses_index || !daemon_socket_path.empty() || !client_socket_path.empty())) {
+        cout << "Checkpoints are only taken by a traversal" << endl;
+        return -1;
+    }
+    if (roots.size() > 1 && (uses_index || checkpoints || !daemon_socket_path.empty() || !client_socket_path.empty())) {
+        error_multiple_specified("directory");
+        return -1;
+    }
+    if (sort_output && (!daemon_socket_path.empty() || !client_socket_path.empty())) {
+        cout << "-sort can not be used with --daemon or --client" << endl;
+        return -1;
+    }
+    if (find_duplicates && (uses_index || checkpoints || !exec_target.empty() ||
+                            !daemon_socket_path.empty() || !client_socket_path.empty())) {
+        cout << "-duplicates only works with a traversal and without -exec" << endl;
+        return -1;
+    }
+    if (find_duplicates && sort_output) {
+        cout << "-duplicates prints groups of files and can not be used with -sort" << endl;
+        return -1;
+    }
+    if (hashing() && (find_duplicates || checkpoints || !exec_target.empty() ||
+                      !daemon_socket_path.empty() || !client_socket_path.empty())) {
+        cout << "-hash can not be used with -duplicates, -exec, checkpoints, --daemon or --client" << endl;
+        return -1;
+    }
+    if (hashing() && output_format != OutputFormat::LINES && output_format != OutputFormat::PRINT0) {
+        cout << "-hash only writes lines, optionally with -print0" << endl;
+        return -1;
+    }
+    if (contents_enabled() && (checkpoints || !daemon_socket_path.empty() || !client_socket_path.empty())) {
+        cout << "-contains can not be used with checkpoints, --daemon or --client" << endl;
+        return -1;
+    }
+    if (group_links && (checkpoints || find_duplicates || top_enabled() || hashing() || !exec_target.empty() ||
+                        !daemon_socket_path.empty() || !client_socket_path.empty())) {
+        cout << "-group-links can not be used with -duplicates, -top, -hash, -exec, checkpoints, --daemon or --client" << endl;
+        return -1;
+    }
+    if ((find_duplicates || hashing() || contents_enabled()) && (type_mask & ~(1u << DT_REG)) != 0) {
+        cout << "-duplicates, -hash and -contains only read regular files" << endl;
+        return -1;
+    }
+    // the indexes only keep the directories as the paths of their entries
+    if (uses_index && (type_mask & (1u << DT_DIR)) != 0) {
+        cout << "-type d can not be answered by an index" << endl;
+        return -1;
+    }
+    // the path index only keeps the modification time, and no owner or mode
+    if (!index_path.empty() && (uid_target != NO_UID || gid_target != NO_GID || perm_mode != PermMode::NONE)) {
+        cout << "--index does not know owners and permissions" << endl;
+        return -1;
+    }
+    if (!index_path.empty() && std::any_of(time_conditions.begin(), time_conditions.end(), [](TimeCondition const& c) {
+            return c.field != TimeField::MODIFICATION;
+        })) {
+        cout << "--index only knows the modification time" << endl;
+        return -1;
+    }
+    if (trace_output_given && !trace_enabled()) {
+        cout << "-trace-top and -trace-json only report the operations of -trace-slow" << endl;
+        return -1;
+    }
+    if (top_key_given && !top_enabled()) {
+        cout << "-by only orders the files of -top" << endl;
+        return -1;
+    }
+    if (top_enabled() && (checkpoints || sort_output || find_duplicates || disk_usage ||
+                          !daemon_socket_path.empty() || !client_socket_path.empty())) {
+        cout << "-top can not be used with -sort, -duplicates, -du, checkpoints, --daemon or --client" << endl;
+        return -1;
+    }
+    if (disk_usage && (uses_index || checkpoints || any_predicate() || contents_enabled() || find_duplicates ||
+                       hashing() || !exec_target.empty() || !daemon_socket_path.empty() ||
+                       !client_socket_path.empty())) {
+        cout << "-du counts every entry of a traversal and takes no predicates or actions" << endl;
+        return -1;
+    }
+    if (disk_usage && output_format != OutputFormat::LINES && output_format != OutputFormat::PRINT0) {
+        cout << "-du only writes lines, optionally with -print0" << endl;
+        return -1;
+    }
+    // a checkpointed -sort writes in traversal order, which does not place matched directories
+    if (checkpoints && sort_output && (type_mask & (1u << DT_DIR)) != 0) {
+        cout << "-sort with checkpoints can not match directories" << endl;
+        return -1;
+    }
+    if (checkpoints && !exec_target.empty()) {
+        cout << "Checkpoints can not be used with -exec" << endl;
+        return -1;
+    }
+
+    if (!hasDir && index_path.empty() && refresh_index_path.empty() && trigram_index_path.empty() &&
+        client_socket_path.empty() && resume_path.empty()) {
+        cout << "Usage: os_find [OPTIONS] DIRECTORY..." << endl;
+        cout << "       os_find --build-index DB DIRECTORY" << endl;
+        cout << "       os_find --refresh-index DB" << endl;
+        cout << "       os_find --index DB [OPTIONS] [DIRECTORY]" << endl;
+        cout << "       os_find --build-trigram-index DB DIRECTORY" << endl;
+        cout << "       os_find --trigram-index DB [OPTIONS] [DIRECTORY]" << endl;
+        cout << "       os_find -resume FILE [OPTIONS] [DIRECTORY]" << endl;
+        cout << "       os_find --daemon SOCKET DIRECTORY" << endl;
+        cout << "       os_find --client SOCKET [OPTIONS] [DIRECTORY]" << endl;
         return -1;
     }
 
     return dirPosition;
 }
 
+// Runs in the daemon: every option is reset, so that nothing leaks from the previous
+// query, even a rejected one. The errors of set_args are collected for the client.
+bool parse_query(std::vector<string> const& args, string& prefix, string& error) {
+    reset_predicates();
+    reset_output();
+    exec_target.clear();
+    hash_algorithm = HashAlgorithm::NONE;
+    contents_target.clear();
+    find_duplicates = false;
+    confirm_sha1 = false;
+    group_links = false;
+    disk_usage = false;
+    usage_in_bytes = false;
+    usage_top = 0;
+    top_count = 0;
+    top_key = TopKey::SIZE;
+    sort_output = false;
+    sort_memory_budget = DEFAULT_SORT_MEMORY_BUDGET;
+    stats_mode = StatsMode::NONE;
+    progress_interval = 0;
+    trace_threshold_ns = 0;
+    trace_top = DEFAULT_TRACE_TOP;
+    trace_json_path.clear();
+    dir_cache_path.clear();
+    checkpoint_path.clear();
+    resume_path.clear();
+    build_index_path.clear();
+    index_path.clear();
+    refresh_index_path.clear();
+    build_trigram_index_path.clear();
+    trigram_index_path.clear();
+    client_socket_path.clear();
+    roots.clear();
+
+    std::vector<char*> query_argv;
+    query_argv.push_back(const_cast<char*>("os_find"));
+    for (auto const& arg : args) {
+        query_argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    std::ostringstream errors;
+    std::streambuf* console = cout.rdbuf(errors.rdbuf());
+    int dirPosition = set_args(static_cast<int>(query_argv.size()), query_argv.data());
+    cout.rdbuf(console);
+    if (dirPosition <= 0) {
+        error = errors.str();
+        return false;
+    }
+    prefix = query_argv[dirPosition];
+    if (prefix.back() != '/') { prefix += '/'; }
+    return true;
+}
+
+// Builds the query sent by --client. The directory is made absolute, as the daemon has
+// another working directory, and the options that only concern this process are kept here.
+// With -exec the daemon only sends the paths, the command is run by the client.
+bool client_query(int argc, char* argv[], int dirPosition, std::vector<string>& args) {
+    for (int i = 1; i < argc; i++) {
+        auto arg = string(argv[i]);
+        if (i == dirPosition) {
+            char resolved[PATH_MAX];
+            if (realpath(argv[i], resolved) == nullptr) {
+                cerr << "Error resolving " << argv[i] << endl;
+                print_error();
+                return false;
+            }
+            args.emplace_back(resolved);
+        } else if (arg == "--stats" || arg == "--stats-json") {
+            continue;
+        } else if (!takes_value(arg)) {
+            args.push_back(arg);
+        } else if (arg == "--client" || arg == "-exec" || arg == "-progress" ||
+                   arg == "-trace-slow" || arg == "-trace-top" || arg == "-trace-json" ||
+                   arg == "-dir-cache") {
+            i++;
+        } else if (arg == "-newer" && argv[i + 1][0] != '/') {
+            // not realpath, as -newer does not follow a symlink named by the last component
+            char cwd[PATH_MAX];
+            if (getcwd(cwd, sizeof(cwd)) == nullptr) {
+                cerr << "Error resolving " << argv[i + 1] << endl;
+                print_error();
+                return false;
+            }
+            args.push_back(arg);
+            args.push_back(string(cwd) + "/" + argv[++i]);
+        } else {
+            args.push_back(arg);
+            args.emplace_back(argv[++i]);
+        }
+    }
+    if (dirPosition == 0) {
+        args.emplace_back("/");
+    }
+    if (!exec_target.empty()) {
+        args.emplace_back("-print0");
+    }
+    return true;
+}
+
+void write_answer(const char* data, size_t size) {
+    write_fully(STDOUT_FILENO, data, size);
+}
+
+// For -exec the answer is NUL separated paths, split into results
+string exec_answer;
+void collect_answer(const char* data, size_t size) {
+    exec_answer.append(data, size);
+    size_t start = 0;
+    size_t end;
+    while ((end = exec_answer.find('\0', start)) != string::npos) {
+        results.push_back(exec_answer.substr(start, end - start));
+        start = end + 1;
+    }
+    exec_answer.erase(0, start);
+}
+
+// Makes the directory absolute and ending with '/', for the daemon and the indexes,
+// which keep it beyond the working directory of this process
+bool resolve_root(const char* directory, string& root) {
+    char resolved[PATH_MAX];
+    if (realpath(directory, resolved) == nullptr) {
+        cerr << "Error resolving " << directory << endl;
+        print_error();
+        return false;
+    }
+    root = resolved;
+    if (root.back() != '/') { root += '/'; }
+    return true;
+}
+
 int main(int argc, char* argv[]) {
     int dirPosition = set_args(argc, argv);
     if (dirPosition == -1) {
         return 0;
     }
-    string path = argv[dirPosition];
-    if (path.back() != '/') { path += '/'; }
+    string path = dirPosition == 0 ? "" : argv[dirPosition];
+    if (!path.empty() && path.back() != '/') { path += '/'; }
 
-    int fd = open(argv[dirPosition], O_RDONLY | O_DIRECTORY);
-    if (fd == -1) {
-        cerr << "Error reading contents of " << path << endl;
-        print_error();
+    bool indexed = !index_path.empty() || !trigram_index_path.empty() ||
+                   !build_index_path.empty() || !build_trigram_index_path.empty();
+    if (dirPosition != 0 && (indexed || !daemon_socket_path.empty()) && !resolve_root(argv[dirPosition], path)) {
+        return 0;
+    }
+
+    if (!daemon_socket_path.empty()) {
+        run_daemon(daemon_socket_path, path, parse_query, report_match);
         return 0;
+    } else if (!client_socket_path.empty()) {
+        std::vector<string> args;
+        if (!client_query(argc, argv, dirPosition, args) ||
+            !run_client(client_socket_path, args, exec_target.empty() ? write_answer : collect_answer)) {
+            return 0;
+        }
+    } else if (!index_path.empty()) {
+        PhaseTimer timer(Phase::TRAVERSAL);
+        if (exec_target.empty()) {
+            write_output_header();
+        }
+        // the index keeps directories in traversal order, not in path order
+        collect_sorted = sort_output;
+        if (!query_index(index_path, path, report_match)) {
+            return 0;
+        }
+    } else if (!trigram_index_path.empty()) {
+        PhaseTimer timer(Phase::TRAVERSAL);
+        if (exec_target.empty()) {
+            write_output_header();
+        }
+        collect_sorted = sort_output;
+        if (!query_trigram_index(trigram_index_path, path, report_match)) {
+            return 0;
+        }
+    } else if (!build_trigram_index_path.empty()) {
+        PhaseTimer timer(Phase::TRAVERSAL);
+        start_progress();
+        bool built = build_trigram_index(build_trigram_index_path, path);
+        stop_progress();
+        if (built) {
+            print_stats(cerr);
+        }
+        return 0;
+    } else if (!build_index_path.empty() || !refresh_index_path.empty()) {
+        PhaseTimer timer(Phase::TRAVERSAL);
+        start_progress();
+        bool built = refresh_index_path.empty() ? build_index(build_index_path, path)
+                                                : refresh_index(refresh_index_path);
+        stop_progress();
+        if (built) {
+            print_stats(cerr);
+        }
+        return 0;
+    } else {
+        Checkpoint checkpoint{};
+        if (!resume_path.empty()) {
+            if (!read_checkpoint(resume_path, checkpoint)) {
+                return 0;
+            }
+            if (!path.empty() && path != checkpoint.root) {
+                cerr << resume_path << " was taken for " << checkpoint.root << endl;
+                return 0;
+            }
+            path = checkpoint.root;
+            // the resumed run goes on checkpointing, into the same file by default
+            if (!checkpoint_enabled()) {
+                checkpoint_path = resume_path;
+            }
+            if (!resume_output(checkpoint.output_bytes)) {
+                return 0;
+            }
+            traversal_counters.matches.store(checkpoint.results, std::memory_order_relaxed);
+        }
+
+        PhaseTimer timer(Phase::TRAVERSAL);
+        // a resumed output already has its header
+        if (exec_target.empty() && resume_path.empty()) {
+            write_output_header();
+        }
+        if (dir_cache_enabled() && !load_dir_cache()) {
+            return 0;
+        }
+        if (checkpoint_enabled()) {
+            start_checkpoints(path);
+        }
+        start_progress();
+        if (resume_path.empty()) {
+            std::vector<string> walked = distinct_roots(roots);
+            // a single root is walked in order when sorting, several ones are interleaved.
+            // The walk reaches a directory at name + '/', after name.txt, so matched directories
+            // go through the sorter too.
+            collect_sorted = sort_output && (walked.size() > 1 || type_wanted(DT_DIR));
+            walk_roots(walked);
+        } else {
+            walk_root(path, checkpoint.entry);
+        }
+        stop_progress();
+        if (dir_cache_enabled() && !save_dir_cache()) {
+            cerr << "Error writing the directory cache " << dir_cache_path << endl;
+        }
+        if (checkpoint_enabled() && flush_output()) {
+            finish_checkpoints();
+        }
+    }
+    if (contents_enabled()) {
+        finish_contents(deliver_locked);
+    }
+    if (top_enabled()) {
+        top_finish(deliver_top);
     }
-    visit(fd, path);
-    close(fd);
+    print_trace_report();
 
     if (exec_target.empty()) {
-        for (const auto &result : results) {
-            cout << result << endl;
+        if (find_duplicates) {
+            report_duplicates();
+        } else if (group_links) {
+            report_link_groups();
+        } else if (collect_sorted) {
+            sort_finish(hashing() ? add_hash_target : emit);
         }
+        if (hashing()) {
+            finish_hashes();
+        }
+        if (disk_usage) {
+            finish_usage();
+        }
+        flush_output();
+        print_stats(cerr);
     } else {
+        if (sort_output) {
+            std::sort(results.begin(), results.end());
+        }
         std::vector<char*> c_results;
         c_results.reserve(results.size() + 2);
         c_results.push_back(const_cast<char*>(exec_target.c_str()));
@@ -273,6 +1019,8 @@ int main(int argc, char* argv[]) {
         }
         c_results.push_back(nullptr);
 
+        print_stats(cerr);
+
         int res = execv(c_results[0], c_results.data());
         if (res == -1) {
             cerr << "Error executing " << exec_target << endl;
@@ -0,0 +1,78 @@
+#include "mapped_file.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+using std::cerr;
+using std::endl;
+
+MappedFile::~MappedFile() {
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
+    }
+}
+
+bool MappedFile::open(std::string const& path) {
+    FileDescriptor fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat stats{};
+    if (!fd.valid() || fstat(fd.get(), &stats) == -1) {
+        cerr << "Error opening " << path << endl;
+        print_error();
+        return false;
+    }
+    if (stats.st_size == 0) {
+        cerr << path << " is empty" << endl;
+        return false;
+    }
+    mapping_size = static_cast<size_t>(stats.st_size);
+    void* address = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    if (address == MAP_FAILED) {
+        cerr << "Error mapping " << path << endl;
+        print_error();
+        return false;
+    }
+    mapping = static_cast<char*>(address);
+    return true;
+}
+
+bool SectionWriter::open(std::string const& target) {
+    path = target;
+    tmp_path = target + ".tmp";
+    fd.reset(::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (!fd.valid()) {
+        cerr << "Error creating " << tmp_path << endl;
+        print_error();
+        return false;
+    }
+    return true;
+}
+
+uint64_t SectionWriter::section(const void* bytes, size_t size) {
+    static const char padding[8] = {};
+    auto pad = static_cast<size_t>((8 - offset % 8) % 8);
+    failed = failed || !write_fully(fd.get(), padding, pad) || !write_fully(fd.get(), bytes, size);
+    uint64_t start = offset + pad;
+    offset = start + size;
+    return start;
+}
+
+bool SectionWriter::commit(const void* header, size_t header_size) {
+    failed = failed || pwrite(fd.get(), header, header_size, 0) != static_cast<ssize_t>(header_size);
+    if (failed) {
+        cerr << "Error writing " << tmp_path << endl;
+        print_error();
+        return false;
+    }
+    if (fsync(fd.get()) == -1 || rename(tmp_path.c_str(), path.c_str()) == -1) {
+        cerr << "Error saving " << path << endl;
+        print_error();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef OS_FIND_MAPPED_FILE_H
+#define OS_FIND_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "fd.h"
+
+// Read-only mapping of a whole file, used to read the indexes in place
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+    ~MappedFile();
+
+    // Prints the reason to stderr on failure
+    bool open(std::string const& path);
+
+    const char* data() const { return mapping; }
+    size_t size() const { return mapping_size; }
+
+private:
+    char* mapping = nullptr;
+    size_t mapping_size = 0;
+};
+
+// Writes a file as a sequence of 8-byte aligned sections, so that the sections can be used
+// in place once mapped. The file is written next to path and renamed over it by commit(),
+// so readers never see half of it.
+class SectionWriter {
+public:
+    // Prints the reason to stderr on failure
+    bool open(std::string const& path);
+
+    // Returns the offset of the section in the file
+    uint64_t section(const void* bytes, size_t size);
+
+    // Rewrites the header at the start of the file, then syncs and renames it
+    bool commit(const void* header, size_t header_size);
+
+    uint64_t size() const { return offset; }
+
+private:
+    std::string path;
+    std::string tmp_path;
+    FileDescriptor fd;
+    uint64_t offset = 0;
+    bool failed = false;
+};
+
+#endif //OS_FIND_MAPPED_FILE_H
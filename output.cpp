@@ -0,0 +1,589 @@
+#include "output.h"
+
+#include <dirent.h>
+#include <endian.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "fd.h"
+#include "stats.h"
+
+OutputFormat output_format = OutputFormat::LINES;
+unsigned binary_fields = 0;
+int output_fd = STDOUT_FILENO;
+
+namespace {
+
+const size_t OUTPUT_BUFFER_SIZE = 1 << 20;
+const int MAX_RECORD_PARTS = 4;
+
+char buffer[OUTPUT_BUFFER_SIZE];
+size_t buffered = 0;
+bool write_failed = false;
+uint64_t written_bytes = 0;
+
+enum class Directive {
+    LITERAL,
+    PATH,
+    NAME,
+    DIRECTORY,
+    INODE,
+    TYPE,
+    SIZE,
+    NLINK,
+    MTIME
+};
+
+struct FormatPart {
+    Directive directive;
+    std::string literal;
+};
+
+std::vector<FormatPart> printf_format;
+
+// longest decimal rendering of the numeric fields, with sign and fraction
+const size_t MAX_NUMBER_LENGTH = 32;
+
+const char DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// writes all iovecs, continuing after partial writes
+bool write_all(iovec* parts, int count) {
+    while (count > 0) {
+        ssize_t written = sys_writev(output_fd, parts, count);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written_bytes += static_cast<uint64_t>(written);
+        auto left = static_cast<size_t>(written);
+        while (count > 0 && left >= parts->iov_len) {
+            left -= parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count > 0) {
+            parts->iov_base = static_cast<char*>(parts->iov_base) + left;
+            parts->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+void report_write_error() {
+    if (!write_failed) {
+        std::cerr << "Error writing results" << std::endl;
+        std::cerr << strerror(errno) << std::endl;
+        write_failed = true;
+    }
+}
+
+// Appends the record to the buffer. A record that does not fit is written
+// together with the buffered data by a single writev instead of two writes.
+void append(iovec* parts, int count) {
+    size_t size = 0;
+    for (int i = 0; i < count; i++) {
+        size += parts[i].iov_len;
+    }
+
+    if (buffered + size > OUTPUT_BUFFER_SIZE) {
+        PhaseTimer timer(Phase::OUTPUT);
+        iovec all[MAX_RECORD_PARTS + 1];
+        all[0] = {buffer, buffered};
+        for (int i = 0; i < count; i++) {
+            all[i + 1] = parts[i];
+        }
+        if (!write_all(all, count + 1)) {
+            report_write_error();
+        }
+        buffered = 0;
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        memcpy(buffer + buffered, parts[i].iov_base, parts[i].iov_len);
+        buffered += parts[i].iov_len;
+    }
+}
+
+void flush_buffer() {
+    if (buffered == 0) {
+        return;
+    }
+    PhaseTimer timer(Phase::OUTPUT);
+    iovec part = {buffer, buffered};
+    if (!write_all(&part, 1)) {
+        report_write_error();
+    }
+    buffered = 0;
+}
+
+// Returns room for size bytes at the end of the buffer, so that a record
+// can be formatted in place, or nullptr if the record can never fit.
+char* reserve(size_t size) {
+    if (size > OUTPUT_BUFFER_SIZE) {
+        return nullptr;
+    }
+    if (buffered + size > OUTPUT_BUFFER_SIZE) {
+        flush_buffer();
+    }
+    return buffer + buffered;
+}
+
+// Converts two digits at a time using DIGIT_PAIRS
+char* write_uint(char* out, uint64_t value) {
+    char digits[20];
+    char* end = digits + sizeof(digits);
+    char* first = end;
+    while (value >= 100) {
+        first -= 2;
+        memcpy(first, DIGIT_PAIRS + (value % 100) * 2, 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        first -= 2;
+        memcpy(first, DIGIT_PAIRS + value * 2, 2);
+    } else {
+        *--first = static_cast<char>('0' + value);
+    }
+    memcpy(out, first, static_cast<size_t>(end - first));
+    return out + (end - first);
+}
+
+// seconds.nanoseconds, like %T@ of GNU find
+char* write_time(char* out, timespec const& time) {
+    int64_t seconds = time.tv_sec;
+    if (seconds < 0) {
+        *out++ = '-';
+        seconds = -seconds;
+    }
+    out = write_uint(out, static_cast<uint64_t>(seconds));
+    *out++ = '.';
+    char fraction[20];
+    char* fraction_end = write_uint(fraction, static_cast<uint64_t>(time.tv_nsec));
+    auto length = static_cast<size_t>(fraction_end - fraction);
+    for (size_t i = length; i < 9; i++) {
+        *out++ = '0';
+    }
+    memcpy(out, fraction, length);
+    return out + length;
+}
+
+char* write_bytes(char* out, const char* data, size_t length) {
+    memcpy(out, data, length);
+    return out + length;
+}
+
+char type_char(unsigned char type) {
+    switch (type) {
+        case DT_REG: return 'f';
+        case DT_DIR: return 'd';
+        case DT_LNK: return 'l';
+        case DT_SOCK: return 's';
+        case DT_FIFO: return 'p';
+        case DT_BLK: return 'b';
+        case DT_CHR: return 'c';
+        default: return 'U';
+    }
+}
+
+char* write_json_string(char* out, const char* data, size_t length) {
+    static const char HEX[] = "0123456789abcdef";
+    for (size_t i = 0; i < length; i++) {
+        auto c = static_cast<unsigned char>(data[i]);
+        if (c == '"' || c == '\\') {
+            *out++ = '\\';
+            *out++ = static_cast<char>(c);
+        } else if (c < 0x20) {
+            out = write_bytes(out, "\\u00", 4);
+            *out++ = HEX[c >> 4];
+            *out++ = HEX[c & 15];
+        } else {
+            *out++ = static_cast<char>(c);
+        }
+    }
+    return out;
+}
+
+bool needs_csv_quotes(const char* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        char c = data[i];
+        if (c == ',' || c == '"' || c == '\n' || c == '\r') {
+            return true;
+        }
+    }
+    return false;
+}
+
+char* write_csv_string(char* out, const char* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] == '"') {
+            *out++ = '"';
+        }
+        *out++ = data[i];
+    }
+    return out;
+}
+
+// Upper bound of the formatted size of a record with the given path length
+size_t record_bound(size_t path_length) {
+    switch (output_format) {
+        case OutputFormat::PRINTF: {
+            size_t bound = 0;
+            for (auto const& part : printf_format) {
+                bound += part.directive == Directive::LITERAL ? part.literal.size()
+                                                              : path_length + MAX_NUMBER_LENGTH;
+            }
+            return bound;
+        }
+        case OutputFormat::JSON:
+            return 6 * path_length + 128;
+        case OutputFormat::CSV:
+            return 2 * path_length + 128;
+        default:
+            return 0;
+    }
+}
+
+char* format_printf(char* out, std::string const& dir_path, const char* name, size_t name_length,
+                    EntryInfo const& info) {
+    for (auto const& part : printf_format) {
+        switch (part.directive) {
+            case Directive::LITERAL:
+                out = write_bytes(out, part.literal.data(), part.literal.size());
+                break;
+            case Directive::PATH:
+                out = write_bytes(out, dir_path.data(), dir_path.size());
+                out = write_bytes(out, name, name_length);
+                break;
+            case Directive::NAME:
+                out = write_bytes(out, name, name_length);
+                break;
+            case Directive::DIRECTORY:
+                // without the trailing slash, unless it is the root
+                out = write_bytes(out, dir_path.data(), dir_path.size() > 1 ? dir_path.size() - 1 : dir_path.size());
+                break;
+            case Directive::INODE:
+                out = write_uint(out, info.ino);
+                break;
+            case Directive::TYPE:
+                *out++ = type_char(info.type);
+                break;
+            case Directive::SIZE:
+                out = write_uint(out, static_cast<uint64_t>(info.stats.st_size));
+                break;
+            case Directive::NLINK:
+                out = write_uint(out, info.stats.st_nlink);
+                break;
+            case Directive::MTIME:
+                out = write_time(out, info.stats.st_mtim);
+                break;
+        }
+    }
+    return out;
+}
+
+char* format_json(char* out, std::string const& dir_path, const char* name, size_t name_length,
+                  EntryInfo const& info) {
+    out = write_bytes(out, "{\"path\":\"", 9);
+    out = write_json_string(out, dir_path.data(), dir_path.size());
+    out = write_json_string(out, name, name_length);
+    out = write_bytes(out, "\",\"ino\":", 8);
+    out = write_uint(out, info.ino);
+    out = write_bytes(out, ",\"type\":\"", 9);
+    *out++ = type_char(info.type);
+    *out++ = '"';
+    // only the fields statx returned, the others are zero
+    if (info.stats_mask & STATX_SIZE) {
+        out = write_bytes(out, ",\"size\":", 8);
+        out = write_uint(out, static_cast<uint64_t>(info.stats.st_size));
+    }
+    if (info.stats_mask & STATX_NLINK) {
+        out = write_bytes(out, ",\"nlink\":", 9);
+        out = write_uint(out, info.stats.st_nlink);
+    }
+    if (info.stats_mask & STATX_MTIME) {
+        out = write_bytes(out, ",\"mtime\":", 9);
+        out = write_time(out, info.stats.st_mtim);
+    }
+    out = write_bytes(out, "}\n", 2);
+    return out;
+}
+
+char* format_csv(char* out, std::string const& dir_path, const char* name, size_t name_length,
+                 EntryInfo const& info) {
+    bool quoted = needs_csv_quotes(dir_path.data(), dir_path.size()) || needs_csv_quotes(name, name_length);
+    if (quoted) {
+        *out++ = '"';
+        out = write_csv_string(out, dir_path.data(), dir_path.size());
+        out = write_csv_string(out, name, name_length);
+        *out++ = '"';
+    } else {
+        out = write_bytes(out, dir_path.data(), dir_path.size());
+        out = write_bytes(out, name, name_length);
+    }
+    *out++ = ',';
+    out = write_uint(out, info.ino);
+    *out++ = ',';
+    *out++ = type_char(info.type);
+    *out++ = ',';
+    if (info.stats_mask & STATX_SIZE) {
+        out = write_uint(out, static_cast<uint64_t>(info.stats.st_size));
+    }
+    *out++ = ',';
+    if (info.stats_mask & STATX_NLINK) {
+        out = write_uint(out, info.stats.st_nlink);
+    }
+    *out++ = ',';
+    if (info.stats_mask & STATX_MTIME) {
+        out = write_time(out, info.stats.st_mtim);
+    }
+    *out++ = '\n';
+    return out;
+}
+
+// Formats a PRINTF, JSON or CSV record straight into the output buffer
+void emit_formatted(std::string const& dir_path, const char* name, EntryInfo const& info) {
+    size_t name_length = strlen(name);
+    size_t bound = record_bound(dir_path.size() + name_length);
+
+    std::vector<char> oversized;
+    char* start = reserve(bound);
+    if (start == nullptr) {
+        oversized.resize(bound);
+        start = oversized.data();
+    }
+
+    char* end;
+    switch (output_format) {
+        case OutputFormat::PRINTF:
+            end = format_printf(start, dir_path, name, name_length, info);
+            break;
+        case OutputFormat::JSON:
+            end = format_json(start, dir_path, name, name_length, info);
+            break;
+        default:
+            end = format_csv(start, dir_path, name, name_length, info);
+            break;
+    }
+
+    auto length = static_cast<size_t>(end - start);
+    if (oversized.empty()) {
+        buffered += length;
+    } else {
+        iovec part = {start, length};
+        append(&part, 1);
+    }
+}
+
+} // namespace
+
+bool output_needs_stats() {
+    switch (output_format) {
+        case OutputFormat::BINARY:
+            return (binary_fields & (FIELD_SIZE | FIELD_NLINK)) != 0;
+        case OutputFormat::PRINTF:
+            for (auto const& part : printf_format) {
+                if (part.directive == Directive::SIZE || part.directive == Directive::NLINK ||
+                    part.directive == Directive::MTIME) {
+                    return true;
+                }
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+uint64_t output_bytes() {
+    return written_bytes + buffered;
+}
+
+bool resume_output(uint64_t bytes) {
+    struct stat stats{};
+    if (fstat(output_fd, &stats) == -1 || !S_ISREG(stats.st_mode)) {
+        written_bytes = bytes;
+        return true;
+    }
+    if (static_cast<uint64_t>(stats.st_size) < bytes) {
+        std::cerr << "The output is shorter than at the checkpoint" << std::endl;
+        return false;
+    }
+    if (ftruncate(output_fd, static_cast<off_t>(bytes)) == -1 ||
+        lseek(output_fd, static_cast<off_t>(bytes), SEEK_SET) == -1) {
+        std::cerr << "Error truncating the output to the checkpoint" << std::endl;
+        std::cerr << strerror(errno) << std::endl;
+        return false;
+    }
+    written_bytes = bytes;
+    return true;
+}
+
+void reset_output() {
+    output_format = OutputFormat::LINES;
+    binary_fields = 0;
+    printf_format.clear();
+    buffered = 0;
+    write_failed = false;
+}
+
+bool parse_printf_format(std::string const& format) {
+    printf_format.clear();
+    std::string literal;
+    auto add = [&literal](Directive directive) {
+        if (!literal.empty()) {
+            printf_format.push_back(FormatPart{Directive::LITERAL, literal});
+            literal.clear();
+        }
+        printf_format.push_back(FormatPart{directive, ""});
+    };
+
+    for (size_t i = 0; i < format.size(); i++) {
+        char c = format[i];
+        if (c == '\\' && i + 1 < format.size()) {
+            switch (format[++i]) {
+                case 'n': literal += '\n'; break;
+                case 't': literal += '\t'; break;
+                case '0': literal += '\0'; break;
+                case '\\': literal += '\\'; break;
+                default: return false;
+            }
+        } else if (c == '%' && i + 1 < format.size()) {
+            switch (format[++i]) {
+                case '%': literal += '%'; break;
+                case 'p': add(Directive::PATH); break;
+                case 'f': add(Directive::NAME); break;
+                case 'h': add(Directive::DIRECTORY); break;
+                case 'i': add(Directive::INODE); break;
+                case 'y': add(Directive::TYPE); break;
+                case 's': add(Directive::SIZE); break;
+                case 'n': add(Directive::NLINK); break;
+                case 'T':
+                    if (i + 1 < format.size() && format[i + 1] == '@') {
+                        i++;
+                        add(Directive::MTIME);
+                        break;
+                    }
+                    return false;
+                default: return false;
+            }
+        } else if (c == '\\' || c == '%') {
+            return false;
+        } else {
+            literal += c;
+        }
+    }
+    if (!literal.empty()) {
+        printf_format.push_back(FormatPart{Directive::LITERAL, literal});
+    }
+    return true;
+}
+
+bool parse_binary_fields(std::string const& value) {
+    binary_fields = 0;
+    std::istringstream list(value);
+    std::string field;
+    while (std::getline(list, field, ',')) {
+        if (field == "ino") {
+            binary_fields |= FIELD_INODE;
+        } else if (field == "size") {
+            binary_fields |= FIELD_SIZE;
+        } else if (field == "nlink") {
+            binary_fields |= FIELD_NLINK;
+        } else if (field != "path") {
+            return false;
+        }
+    }
+    return true;
+}
+
+void write_output_header() {
+    if (output_format == OutputFormat::CSV) {
+        static char header[] = "path,ino,type,size,nlink,mtime\n";
+        iovec part = {header, sizeof(header) - 1};
+        append(&part, 1);
+    } else if (output_format == OutputFormat::BINARY) {
+        char header[] = {'O', 'S', 'F', 'B', 1, static_cast<char>(binary_fields)};
+        iovec part = {header, sizeof(header)};
+        append(&part, 1);
+    }
+}
+
+void emit(std::string const& dir_path, const char* name, EntryInfo const& info) {
+    if (output_format == OutputFormat::PRINTF || output_format == OutputFormat::JSON ||
+        output_format == OutputFormat::CSV) {
+        emit_formatted(dir_path, name, info);
+        return;
+    }
+
+    iovec parts[MAX_RECORD_PARTS];
+    int count = 0;
+    size_t name_length = strlen(name);
+
+    uint32_t length = 0;
+    if (output_format == OutputFormat::BINARY) {
+        length = htole32(static_cast<uint32_t>(dir_path.size() + name_length));
+        parts[count++] = {&length, sizeof(length)};
+    }
+    parts[count++] = {const_cast<char*>(dir_path.data()), dir_path.size()};
+    parts[count++] = {const_cast<char*>(name), name_length};
+
+    static char newline = '\n';
+    static char nul = '\0';
+    uint64_t fields[3];
+    switch (output_format) {
+        case OutputFormat::LINES:
+            parts[count++] = {&newline, 1};
+            break;
+        case OutputFormat::PRINT0:
+            parts[count++] = {&nul, 1};
+            break;
+        default: {
+            int field_count = 0;
+            if (binary_fields & FIELD_INODE) {
+                fields[field_count++] = htole64(info.ino);
+            }
+            if (binary_fields & FIELD_SIZE) {
+                fields[field_count++] = htole64(static_cast<uint64_t>(info.stats.st_size));
+            }
+            if (binary_fields & FIELD_NLINK) {
+                fields[field_count++] = htole64(info.stats.st_nlink);
+            }
+            if (field_count > 0) {
+                parts[count++] = {fields, field_count * sizeof(uint64_t)};
+            }
+            break;
+        }
+    }
+    append(parts, count);
+}
+
+void emit_text(std::string const& text) {
+    iovec part = {const_cast<char*>(text.data()), text.size()};
+    append(&part, 1);
+}
+
+void emit_group_end() {
+    static char newline = '\n';
+    static char nul = '\0';
+    if (output_format == OutputFormat::LINES || output_format == OutputFormat::PRINT0) {
+        iovec part = {output_format == OutputFormat::LINES ? &newline : &nul, 1};
+        append(&part, 1);
+    }
+}
+
+bool flush_output() {
+    flush_buffer();
+    return !write_failed;
+}
@@ -0,0 +1,73 @@
+#ifndef OS_FIND_OUTPUT_H
+#define OS_FIND_OUTPUT_H
+
+#include <cstdint>
+#include <string>
+
+#include "entry.h"
+
+enum class OutputFormat {
+    LINES,   // path and '\n'
+    PRINT0,  // path and '\0'
+    BINARY,  // length-prefixed records, see write_output_header()
+    PRINTF,  // user format, see parse_printf_format()
+    JSON,    // one JSON object per line
+    CSV      // header line, then one row per result
+};
+
+// Optional fields of a binary record, written in this order after the path
+enum BinaryField : unsigned {
+    FIELD_INODE = 1,
+    FIELD_SIZE = 2,
+    FIELD_NLINK = 4
+};
+
+extern OutputFormat output_format;
+extern unsigned binary_fields;
+// where results are written, stdout unless the daemon answers a client
+extern int output_fd;
+
+// Restores the default format and drops anything buffered, before the daemon parses a query
+void reset_output();
+
+// true if the chosen output needs stats that the predicates may not have read
+bool output_needs_stats();
+
+// Compiles a -printf format. Supported directives are %p (path), %f (name),
+// %h (directory), %i (inode), %y (type), %s (size), %n (hardlinks),
+// %T@ (modification time in seconds since the epoch), %% and the escapes \n, \t, \0, \\.
+bool parse_printf_format(std::string const& format);
+
+// Parses a comma separated list of path, ino, size, nlink into binary_fields
+bool parse_binary_fields(std::string const& value);
+
+// JSON and CSV output only contain the stat fields (size, nlink, mtime)
+// when matches() had to read the stats anyway; they never stat on their own.
+
+// Binary output starts with the magic "OSFB", a version byte and a byte with binary_fields.
+// Each record is then a little-endian u32 path length, the path bytes and
+// a little-endian u64 for every selected field.
+// CSV output starts with a header line.
+void write_output_header();
+
+// Appends one result to the output buffer, flushing it when full
+void emit(std::string const& dir_path, const char* name, EntryInfo const& info);
+
+// Appends text formatted elsewhere, like the lines of -hash, as it is
+void emit_text(std::string const& text);
+
+// Bytes of output so far, buffered ones included
+uint64_t output_bytes();
+
+// Continues the output of an interrupted run that had written bytes. If the output is
+// a regular file, whatever was written after that is dropped, so no result is repeated.
+bool resume_output(uint64_t bytes);
+
+// Ends a group of results, like a group of duplicates: an empty line for line output,
+// an empty record for -print0, nothing for the other formats
+void emit_group_end();
+
+// Writes out everything buffered. Returns false if writing failed.
+bool flush_output();
+
+#endif //OS_FIND_OUTPUT_H
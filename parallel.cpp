@@ -0,0 +1,38 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "progress.h"
+#include "stats.h"
+
+namespace {
+
+const unsigned MIN_THREADS = 4;
+
+} // namespace
+
+void parallel_for(size_t count, std::function<void(size_t)> const& task) {
+    if (count == 1) {
+        task(0);
+        return;
+    }
+    std::atomic<size_t> next{0};
+    auto thread_count = std::min<size_t>(count, std::max(std::thread::hardware_concurrency(), MIN_THREADS));
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thread_count; t++) {
+        threads.emplace_back([&task, &next, count] {
+            register_thread_counters();
+            for (size_t i; (i = next.fetch_add(1)) < count;) {
+                task(i);
+            }
+            retire_thread_counters();
+            merge_thread_stats();
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
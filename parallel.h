@@ -0,0 +1,13 @@
+#ifndef OS_FIND_PARALLEL_H
+#define OS_FIND_PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Runs task(i) for every i below count on a pool of threads, each taking the next index
+// once done with one. The work is mostly waiting for the file system, so the pool has at
+// least 4 threads even on few CPUs. A single task runs on the calling thread.
+// The counters and stats of the pool threads are added to the totals when they finish.
+void parallel_for(size_t count, std::function<void(size_t)> const& task);
+
+#endif //OS_FIND_PARALLEL_H
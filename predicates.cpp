@@ -0,0 +1,441 @@
+#include "predicates.h"
+
+#include <fnmatch.h>
+#include <grp.h>
+#include <pwd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <mutex>
+
+#include "fd.h"
+#include "inode_table.h"
+
+ino64_t inode_target;
+std::string name_target;
+SizeCondition size_conditions[MAX_SIZE_CONDITIONS];
+int size_condition_count;
+bool size_rounded;
+nlink_t nlinks_target;
+bool unique_inode;
+unsigned type_mask;
+uid_t uid_target = NO_UID;
+gid_t gid_target = NO_GID;
+PermMode perm_mode = PermMode::NONE;
+mode_t perm_target;
+std::vector<TimeCondition> time_conditions;
+
+namespace {
+
+bool name_pattern = false;
+// inodes with several links that already matched, shared by the threads walking roots
+std::mutex seen_mutex;
+InodeTable seen_inodes;
+
+uint64_t unit_of(char suffix) {
+    switch (suffix) {
+        case 'c': return 1;
+        case 'b': return 512;
+        case 'k': return 1ULL << 10;
+        case 'M': return 1ULL << 20;
+        case 'G': return 1ULL << 30;
+        case 'T': return 1ULL << 40;
+        default: return 0;
+    }
+}
+
+bool matches_size(SizeCondition const& condition, uint64_t size) {
+    uint64_t unit = condition.unit != 0 ? condition.unit : size_rounded ? 512 : 1;
+    if (size_rounded) {
+        uint64_t units = size / unit + (size % unit != 0 ? 1 : 0);
+        switch (condition.mode) {
+            case SizeMode::LESS: return units < condition.count;
+            case SizeMode::EQUAL: return units == condition.count;
+            case SizeMode::GREATER: return units > condition.count;
+            case SizeMode::NONE: assert(false);
+        }
+    }
+    // add_size_condition() made sure that this does not overflow for the largest unit
+    uint64_t target = condition.count * unit;
+    switch (condition.mode) {
+        case SizeMode::LESS: return size <= target;
+        case SizeMode::EQUAL: return size == target;
+        case SizeMode::GREATER: return size >= target;
+        case SizeMode::NONE: assert(false);
+    }
+    return false;
+}
+
+const int64_t MINUTE_NS = 60LL * 1000000000;
+const int64_t DAY_NS = 24 * 60 * MINUTE_NS;
+
+int64_t timestamp_ns(struct stat const& stats, TimeField field) {
+    switch (field) {
+        case TimeField::ACCESS: return to_ns(stats.st_atim);
+        case TimeField::CHANGE: return to_ns(stats.st_ctim);
+        default: return to_ns(stats.st_mtim);
+    }
+}
+
+// Parses a decimal number into id; false if it is not one or does not fit
+template<typename Id>
+bool parse_id(std::string const& value, Id& id) {
+    if (value.empty() || value.size() > 10) {
+        return false;
+    }
+    uint64_t number = 0;
+    for (char c : value) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        number = number * 10 + static_cast<uint64_t>(c - '0');
+    }
+    if (number >= static_cast<Id>(-1)) {
+        return false;
+    }
+    id = static_cast<Id>(number);
+    return true;
+}
+
+// Applies symbolic clauses like u+w,go-rx,a=r to a mode starting at 0
+bool parse_symbolic_mode(std::string const& value, mode_t& mode) {
+    mode = 0;
+    size_t i = 0;
+    while (true) {
+        mode_t who = 0;
+        for (; i < value.size() && strchr("ugoa", value[i]) != nullptr; i++) {
+            who |= value[i] == 'u' ? (S_ISUID | S_IRWXU)
+                 : value[i] == 'g' ? (S_ISGID | S_IRWXG)
+                 : value[i] == 'o' ? S_IRWXO : (S_ISUID | S_ISGID | S_ISVTX | S_IRWXU | S_IRWXG | S_IRWXO);
+        }
+        if (who == 0) {
+            who = S_ISUID | S_ISGID | S_ISVTX | S_IRWXU | S_IRWXG | S_IRWXO;
+        }
+        if (i == value.size() || strchr("+-=", value[i]) == nullptr) {
+            return false;
+        }
+        char op = value[i++];
+        mode_t bits = 0;
+        for (; i < value.size() && value[i] != ','; i++) {
+            switch (value[i]) {
+                case 'r': bits |= S_IRUSR | S_IRGRP | S_IROTH; break;
+                case 'w': bits |= S_IWUSR | S_IWGRP | S_IWOTH; break;
+                case 'x': bits |= S_IXUSR | S_IXGRP | S_IXOTH; break;
+                case 's': bits |= S_ISUID | S_ISGID; break;
+                case 't': bits |= S_ISVTX; break;
+                default: return false;
+            }
+        }
+        bits &= who;
+        if (op == '+') {
+            mode |= bits;
+        } else if (op == '-') {
+            mode &= ~bits;
+        } else {
+            mode = (mode & ~who) | bits;
+        }
+        if (i == value.size()) {
+            return true;
+        }
+        i++;
+    }
+}
+
+} // namespace
+
+bool set_user_target(std::string const& user) {
+    struct passwd* entry = getpwnam(user.c_str());
+    if (entry != nullptr) {
+        uid_target = entry->pw_uid;
+        return true;
+    }
+    return parse_id(user, uid_target);
+}
+
+bool set_group_target(std::string const& group) {
+    struct group* entry = getgrnam(group.c_str());
+    if (entry != nullptr) {
+        gid_target = entry->gr_gid;
+        return true;
+    }
+    return parse_id(group, gid_target);
+}
+
+bool set_uid_target(std::string const& uid) {
+    return parse_id(uid, uid_target);
+}
+
+bool set_gid_target(std::string const& gid) {
+    return parse_id(gid, gid_target);
+}
+
+bool set_perm_target(std::string const& value) {
+    std::string mode = value;
+    perm_mode = PermMode::EXACT;
+    if (!mode.empty() && (mode[0] == '-' || mode[0] == '/')) {
+        perm_mode = mode[0] == '-' ? PermMode::ALL : PermMode::ANY;
+        mode.erase(0, 1);
+    }
+    if (!mode.empty() && mode.find_first_not_of("01234567") == std::string::npos) {
+        unsigned long octal = std::stoul(mode, nullptr, 8);
+        if (octal > 07777) {
+            return false;
+        }
+        perm_target = static_cast<mode_t>(octal);
+        return true;
+    }
+    return parse_symbolic_mode(mode, perm_target);
+}
+
+bool add_time_condition(std::string const& option, std::string const& value) {
+    TimeCondition condition{TimeField::MODIFICATION, INT64_MIN, INT64_MAX};
+    char field = option[1];
+    condition.field = field == 'a' ? TimeField::ACCESS : field == 'c' ? TimeField::CHANGE : TimeField::MODIFICATION;
+    int64_t unit_ns = option.compare(2, std::string::npos, "min") == 0 ? MINUTE_NS : DAY_NS;
+
+    size_t i = 0;
+    char sign = value.empty() ? '\0' : value[0];
+    if (sign == '-' || sign == '+') {
+        i++;
+    }
+    if (i == value.size()) {
+        return false;
+    }
+    int64_t count = 0;
+    for (; i < value.size(); i++) {
+        if (value[i] < '0' || value[i] > '9') {
+            return false;
+        }
+        count = count * 10 + (value[i] - '0');
+        // older than the epoch by far, which no timestamp is
+        if (count > INT64_MAX / unit_ns / 4) {
+            return false;
+        }
+    }
+
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t now_ns = to_ns(now);
+    int64_t bound = now_ns - count * unit_ns;
+    if (sign == '-') {
+        condition.after_ns = bound;
+    } else if (unit_ns == MINUTE_NS) {
+        // GNU find compares minutes exactly: +N is older than N minutes, N is (N - 1, N]
+        if (sign == '+') {
+            condition.up_to_ns = bound - 1;
+        } else {
+            condition.after_ns = bound - 1;
+            condition.up_to_ns = bound + unit_ns - 1;
+        }
+    } else {
+        // and rounds days down: +N is at least N + 1 days, N is [N, N + 1)
+        if (sign == '+') {
+            condition.up_to_ns = bound - unit_ns;
+        } else {
+            condition.after_ns = bound - unit_ns;
+            condition.up_to_ns = bound;
+        }
+    }
+    time_conditions.push_back(condition);
+    return true;
+}
+
+bool add_newer_condition(std::string const& path) {
+    struct stat reference{};
+    unsigned returned_mask = 0;
+    if (stat_entry(AT_FDCWD, path.c_str(), STATX_MTIME, &reference, returned_mask) == -1) {
+        return false;
+    }
+    time_conditions.push_back(TimeCondition{TimeField::MODIFICATION, to_ns(reference.st_mtim), INT64_MAX});
+    return true;
+}
+
+bool add_type_targets(std::string const& value) {
+    for (size_t i = 0; i < value.size(); i += 2) {
+        unsigned char type;
+        switch (value[i]) {
+            case 'f': type = DT_REG; break;
+            case 'd': type = DT_DIR; break;
+            case 'l': type = DT_LNK; break;
+            case 's': type = DT_SOCK; break;
+            case 'p': type = DT_FIFO; break;
+            case 'b': type = DT_BLK; break;
+            case 'c': type = DT_CHR; break;
+            default: return false;
+        }
+        if (i + 1 < value.size() && value[i + 1] != ',') {
+            return false;
+        }
+        type_mask |= 1u << type;
+    }
+    return !value.empty() && value.back() != ',';
+}
+
+bool add_size_condition(std::string const& value) {
+    if (size_condition_count == MAX_SIZE_CONDITIONS) {
+        return false;
+    }
+    SizeCondition condition{SizeMode::EQUAL, 0, 0};
+    size_t i = 0;
+    if (i < value.size() && (value[i] == '-' || value[i] == '=' || value[i] == '+')) {
+        condition.mode = value[i] == '-' ? SizeMode::LESS : value[i] == '=' ? SizeMode::EQUAL : SizeMode::GREATER;
+        i++;
+    }
+    size_t digits_start = i;
+    for (; i < value.size() && value[i] >= '0' && value[i] <= '9'; i++) {
+        auto digit = static_cast<uint64_t>(value[i] - '0');
+        if (condition.count > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        condition.count = condition.count * 10 + digit;
+    }
+    if (i == digits_start) {
+        return false;
+    }
+    if (i + 1 == value.size()) {
+        condition.unit = unit_of(value[i]);
+        if (condition.unit == 0) {
+            return false;
+        }
+    } else if (i != value.size()) {
+        return false;
+    }
+    // the unit of a value without one is only known once -size-rounded is parsed
+    if (condition.count > UINT64_MAX / (condition.unit != 0 ? condition.unit : 512)) {
+        return false;
+    }
+    size_conditions[size_condition_count++] = condition;
+    return true;
+}
+
+void set_name_target(std::string const& name) {
+    name_target = name;
+    name_pattern = name.find_first_of("*?[\\") != std::string::npos;
+}
+
+bool name_is_pattern() {
+    return name_pattern;
+}
+
+void reset_predicates() {
+    inode_target = 0;
+    set_name_target("");
+    size_condition_count = 0;
+    size_rounded = false;
+    nlinks_target = 0;
+    unique_inode = false;
+    seen_inodes.clear();
+    time_conditions.clear();
+    type_mask = 0;
+    uid_target = NO_UID;
+    gid_target = NO_GID;
+    perm_mode = PermMode::NONE;
+    perm_target = 0;
+}
+
+bool any_predicate() {
+    return inode_target != 0 || !name_target.empty() || type_mask != 0 || predicates_need_stats();
+}
+
+bool matches_dirent(ino64_t ino, const char* name) {
+    if (inode_target != 0 &&
+        ino != inode_target) {
+            return false;
+    }
+
+    if (!name_target.empty()) {
+        // plain names are compared directly, which is much cheaper than fnmatch
+        if (name_pattern ? fnmatch(name_target.c_str(), name, 0) != 0 : name_target != name) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool predicates_need_stats() {
+    return size_condition_count != 0 || nlinks_target != 0 || unique_inode || !time_conditions.empty() ||
+           uid_target != NO_UID || gid_target != NO_GID || perm_mode != PermMode::NONE;
+}
+
+unsigned predicates_statx_mask() {
+    unsigned mask = 0;
+    if (size_condition_count != 0) {
+        mask |= STATX_SIZE;
+    }
+    if (nlinks_target != 0) {
+        mask |= STATX_NLINK;
+    }
+    if (unique_inode) {
+        mask |= STATX_NLINK | STATX_INO;
+    }
+    if (uid_target != NO_UID) {
+        mask |= STATX_UID;
+    }
+    if (gid_target != NO_GID) {
+        mask |= STATX_GID;
+    }
+    if (perm_mode != PermMode::NONE) {
+        mask |= STATX_MODE;
+    }
+    for (auto const& condition : time_conditions) {
+        mask |= condition.field == TimeField::ACCESS ? STATX_ATIME
+              : condition.field == TimeField::CHANGE ? STATX_CTIME : STATX_MTIME;
+    }
+    return mask;
+}
+
+bool matches_stats(struct stat const& stats) {
+    for (int i = 0; i < size_condition_count; i++) {
+        if (!matches_size(size_conditions[i], static_cast<uint64_t>(stats.st_size))) {
+            return false;
+        }
+    }
+
+    if (nlinks_target != 0 &&
+        nlinks_target != stats.st_nlink) {
+        return false;
+    }
+
+    if (uid_target != NO_UID && stats.st_uid != uid_target) {
+        return false;
+    }
+    if (gid_target != NO_GID && stats.st_gid != gid_target) {
+        return false;
+    }
+    mode_t permissions = stats.st_mode & 07777;
+    switch (perm_mode) {
+        case PermMode::EXACT:
+            if (permissions != perm_target) { return false; }
+            break;
+        case PermMode::ALL:
+            if ((permissions & perm_target) != perm_target) { return false; }
+            break;
+        case PermMode::ANY:
+            if (perm_target != 0 && (permissions & perm_target) == 0) { return false; }
+            break;
+        case PermMode::NONE:
+            break;
+    }
+
+    for (auto const& condition : time_conditions) {
+        int64_t timestamp = timestamp_ns(stats, condition.field);
+        if (timestamp <= condition.after_ns || timestamp > condition.up_to_ns) {
+            return false;
+        }
+    }
+
+    // last, so that only matching paths are remembered; a single link is always the first
+    if (unique_inode && stats.st_nlink > 1) {
+        bool inserted;
+        std::lock_guard<std::mutex> guard(seen_mutex);
+        seen_inodes.insert(stats.st_dev, stats.st_ino, 0, inserted);
+        if (!inserted) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,131 @@
+#ifndef OS_FIND_PREDICATES_H
+#define OS_FIND_PREDICATES_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class SizeMode {
+    NONE,
+    LESS,
+    EQUAL,
+    GREATER
+};
+
+// -size [-=+]N[unit]: at most, exactly or at least N units. The unit is c (bytes, the
+// default), b (512-byte blocks), k, M, G or T (powers of 1024).
+struct SizeCondition {
+    SizeMode mode;
+    uint64_t count;
+    // 0 if the value has no unit
+    uint64_t unit;
+};
+
+const int MAX_SIZE_CONDITIONS = 2;
+
+enum class PermMode {
+    NONE,
+    EXACT,  // -perm MODE: the permission bits are exactly MODE
+    ALL,    // -perm -MODE: all bits of MODE are set
+    ANY     // -perm /MODE: some bit of MODE is set, or MODE is 0
+};
+
+// no -uid or -user, no -gid or -group
+const uid_t NO_UID = static_cast<uid_t>(-1);
+const gid_t NO_GID = static_cast<gid_t>(-1);
+
+enum class TimeField {
+    ACCESS,
+    CHANGE,
+    MODIFICATION
+};
+
+// A time predicate: the timestamp must be after after_ns and not after up_to_ns,
+// both in nanoseconds since the epoch
+struct TimeCondition {
+    TimeField field;
+    int64_t after_ns;
+    int64_t up_to_ns;
+};
+
+extern ino64_t inode_target;
+// -name is a shell pattern, like in GNU find
+extern std::string name_target;
+// -size can be given twice for a range, like -size +1G -size -10G
+extern SizeCondition size_conditions[MAX_SIZE_CONDITIONS];
+extern int size_condition_count;
+// -size-rounded: sizes are compared like GNU find does, rounded up to the unit of the
+// value, strictly for - and +, and in 512-byte blocks for a value without a unit
+extern bool size_rounded;
+extern nlink_t nlinks_target;
+// -uid and -user, -gid and -group; names are resolved once, when parsed
+extern uid_t uid_target;
+extern gid_t gid_target;
+extern PermMode perm_mode;
+extern mode_t perm_target;
+// -type: bit 1 << DT_ of every wanted type; 0 matches regular files only
+extern unsigned type_mask;
+// -atime, -mtime, -mmin, -newer and the like; all of them must hold
+extern std::vector<TimeCondition> time_conditions;
+// -unique-inode: only the first matched path of a file with several links matches
+extern bool unique_inode;
+
+// Parses a user name or number into uid_target, a group name or number into gid_target
+bool set_user_target(std::string const& user);
+bool set_group_target(std::string const& group);
+
+// Parses the number of -uid or -gid
+bool set_uid_target(std::string const& uid);
+bool set_gid_target(std::string const& gid);
+
+// Parses [-/]MODE of -perm, MODE being octal or symbolic like u+w,o=r as for chmod
+bool set_perm_target(std::string const& value);
+
+// Parses the -type letters f, d, l, s, p, b and c, separated by commas, into type_mask
+bool add_type_targets(std::string const& value);
+
+// true if entries of the dirent type can match; answered without any stat
+inline bool type_wanted(unsigned char type) {
+    return type_mask == 0 ? type == DT_REG : (type_mask & (1u << type)) != 0;
+}
+
+// Parses a -size value into the next size condition. Returns false if it is malformed
+// or does not fit 64 bits.
+bool add_size_condition(std::string const& value);
+
+// Parses [-+]N of -atime, -ctime, -mtime (in days) or -amin, -cmin, -mmin (in minutes)
+// into a time condition with the rounding of GNU find. Ages count from now.
+bool add_time_condition(std::string const& option, std::string const& value);
+
+// -newer FILE: the modification time is later than the one of FILE, read now.
+// A symlink FILE is not followed, as find does by default (-P).
+bool add_newer_condition(std::string const& path);
+
+// Sets name_target, checking once whether it has wildcards
+void set_name_target(std::string const& name);
+
+// true if name_target has wildcards, false if it is matched as a plain string
+bool name_is_pattern();
+
+// Clears all predicates, before the daemon parses a query
+void reset_predicates();
+
+// true if any predicate is set
+bool any_predicate();
+
+// Checks the predicates answered by the dirent alone
+bool matches_dirent(ino64_t ino, const char* name);
+
+// true if some predicate needs the stats of the entry
+bool predicates_need_stats();
+
+// The statx fields the predicates look at
+unsigned predicates_statx_mask();
+
+// Checks the predicates that need the stats of the entry
+bool matches_stats(struct stat const& stats);
+
+#endif //OS_FIND_PREDICATES_H
@@ -0,0 +1,128 @@
+#include "progress.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+thread_local TraversalCounters traversal_counters{};
+double progress_interval = 0;
+
+namespace {
+
+std::mutex counters_mutex;
+// initialized by the main thread, so it starts with the counters of the main thread
+std::vector<TraversalCounters*> registered_counters{&traversal_counters};
+// directories, entries and matches of the threads that are gone
+uint64_t retired_counts[3];
+
+std::atomic<uint64_t> TraversalCounters::* const COUNTERS[3] = {
+    &TraversalCounters::directories, &TraversalCounters::entries, &TraversalCounters::matches
+};
+
+std::mutex current_directory_mutex;
+std::string current_directory;
+
+std::thread reporter;
+std::mutex stop_mutex;
+std::condition_variable stop_condition;
+bool stop_requested = false;
+
+double rate(uint64_t count, double seconds) {
+    return seconds > 0 ? static_cast<double>(count) / seconds : 0.0;
+}
+
+void report_loop() {
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    const auto interval = std::chrono::duration<double>(progress_interval);
+
+    auto last_time = start;
+    uint64_t last_directories = 0;
+    uint64_t last_entries = 0;
+
+    std::unique_lock<std::mutex> lock(stop_mutex);
+    while (!stop_condition.wait_for(lock, interval, [] { return stop_requested; })) {
+        auto now = clock::now();
+        uint64_t directories = counter_total(&TraversalCounters::directories);
+        uint64_t entries = counter_total(&TraversalCounters::entries);
+        uint64_t matches = counter_total(&TraversalCounters::matches);
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        double since_last = std::chrono::duration<double>(now - last_time).count();
+
+        std::string directory;
+        {
+            std::lock_guard<std::mutex> guard(current_directory_mutex);
+            directory = current_directory;
+        }
+
+        std::cerr << std::fixed << std::setprecision(1)
+                  << "[" << elapsed << "s] "
+                  << directories << " dirs (" << std::setprecision(0)
+                  << rate(directories - last_directories, since_last) << "/s), "
+                  << entries << " entries (" << rate(entries - last_entries, since_last) << "/s), "
+                  << matches << " matches, in " << directory << std::endl;
+
+        last_time = now;
+        last_directories = directories;
+        last_entries = entries;
+    }
+}
+
+} // namespace
+
+void register_thread_counters() {
+    std::lock_guard<std::mutex> guard(counters_mutex);
+    registered_counters.push_back(&traversal_counters);
+}
+
+void retire_thread_counters() {
+    std::lock_guard<std::mutex> guard(counters_mutex);
+    for (int i = 0; i < 3; i++) {
+        retired_counts[i] += (traversal_counters.*COUNTERS[i]).load(std::memory_order_relaxed);
+    }
+    registered_counters.erase(std::find(registered_counters.begin(), registered_counters.end(), &traversal_counters));
+}
+
+uint64_t counter_total(std::atomic<uint64_t> TraversalCounters::* counter) {
+    std::lock_guard<std::mutex> guard(counters_mutex);
+    uint64_t total = 0;
+    for (int i = 0; i < 3; i++) {
+        if (COUNTERS[i] == counter) {
+            total = retired_counts[i];
+        }
+    }
+    for (auto counters : registered_counters) {
+        total += (counters->*counter).load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void set_current_directory(std::string const& path) {
+    std::lock_guard<std::mutex> guard(current_directory_mutex);
+    current_directory = path;
+}
+
+void start_progress() {
+    if (!progress_enabled()) {
+        return;
+    }
+    stop_requested = false;
+    reporter = std::thread(report_loop);
+}
+
+void stop_progress() {
+    if (!reporter.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(stop_mutex);
+        stop_requested = true;
+    }
+    stop_condition.notify_one();
+    reporter.join();
+}
@@ -0,0 +1,48 @@
+#ifndef OS_FIND_PROGRESS_H
+#define OS_FIND_PROGRESS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Counters of the traversal, read concurrently by the progress reporter.
+// Each thread walking the tree has its own counters, so every counter has a single writer
+// and is bumped with a relaxed load and store (plain movs on x86) instead of a locked
+// read-modify-write.
+struct TraversalCounters {
+    std::atomic<uint64_t> directories;
+    std::atomic<uint64_t> entries;
+    std::atomic<uint64_t> matches;
+};
+
+extern thread_local TraversalCounters traversal_counters;
+
+// Makes the counters of the calling thread part of the totals.
+// The counters of the main thread are registered from the start.
+void register_thread_counters();
+
+// Moves the counters of the calling thread into the totals, before the thread exits
+void retire_thread_counters();
+
+// Sum of a counter over all threads
+uint64_t counter_total(std::atomic<uint64_t> TraversalCounters::* counter);
+
+inline void bump(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// 0 disables progress reporting
+extern double progress_interval;
+
+inline bool progress_enabled() {
+    return progress_interval > 0;
+}
+
+// Publishes the directory being read. Called once per directory, never per entry.
+void set_current_directory(std::string const& path);
+
+// Starts and stops the reporter thread printing to stderr every progress_interval seconds
+void start_progress();
+void stop_progress();
+
+#endif //OS_FIND_PROGRESS_H
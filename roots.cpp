@@ -0,0 +1,92 @@
+#include "roots.h"
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <iostream>
+#include <utility>
+
+#include "fd.h"
+
+namespace {
+
+typedef std::pair<dev_t, ino_t> Identity;
+
+struct RootInfo {
+    bool known = false;
+    Identity identity;
+    // the directories above the root, up to /
+    std::vector<Identity> ancestors;
+};
+
+RootInfo describe(std::string const& root) {
+    RootInfo info;
+    FileDescriptor fd(sys_openat(AT_FDCWD, root.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC));
+    struct stat stats{};
+    if (!fd.valid() || sys_fstat(fd.get(), &stats) == -1) {
+        return info;
+    }
+    info.known = true;
+    info.identity = Identity(stats.st_dev, stats.st_ino);
+
+    Identity current = info.identity;
+    while (true) {
+        FileDescriptor parent(sys_openat(fd.get(), "..", O_PATH | O_DIRECTORY | O_CLOEXEC));
+        if (!parent.valid() || sys_fstat(parent.get(), &stats) == -1) {
+            break;
+        }
+        Identity identity(stats.st_dev, stats.st_ino);
+        // ".." of / is / itself
+        if (identity == current) {
+            break;
+        }
+        info.ancestors.push_back(identity);
+        current = identity;
+        fd = std::move(parent);
+    }
+    return info;
+}
+
+} // namespace
+
+std::vector<std::string> distinct_roots(std::vector<std::string> const& roots) {
+    std::vector<RootInfo> infos;
+    infos.reserve(roots.size());
+    for (auto const& root : roots) {
+        infos.push_back(describe(root));
+    }
+
+    std::vector<std::string> kept;
+    std::vector<size_t> kept_indices;
+    for (size_t i = 0; i < roots.size(); i++) {
+        if (!infos[i].known) {
+            kept.push_back(roots[i]);
+            kept_indices.push_back(i);
+            continue;
+        }
+        bool skipped = false;
+        for (size_t j : kept_indices) {
+            if (infos[j].known && infos[j].identity == infos[i].identity) {
+                std::cerr << "Skipping " << roots[i] << ", it is the same directory as " << roots[j] << std::endl;
+                skipped = true;
+                break;
+            }
+        }
+        for (size_t j = 0; j < roots.size() && !skipped; j++) {
+            if (j == i || !infos[j].known) {
+                continue;
+            }
+            for (auto const& ancestor : infos[i].ancestors) {
+                if (ancestor == infos[j].identity) {
+                    std::cerr << "Skipping " << roots[i] << ", it is inside " << roots[j] << std::endl;
+                    skipped = true;
+                    break;
+                }
+            }
+        }
+        if (!skipped) {
+            kept.push_back(roots[i]);
+            kept_indices.push_back(i);
+        }
+    }
+    return kept;
+}
@@ -0,0 +1,14 @@
+#ifndef OS_FIND_ROOTS_H
+#define OS_FIND_ROOTS_H
+
+#include <string>
+#include <vector>
+
+// Drops the roots that are the same directory as an earlier root or lie inside another root.
+// Directories are compared by (dev, ino), and a root is inside another one if the other is
+// among the directories reached from it through "..", so neither symlinks nor different
+// spellings of a path can make a tree be walked twice. Roots that can not be opened are
+// kept, the traversal reports them.
+std::vector<std::string> distinct_roots(std::vector<std::string> const& roots);
+
+#endif //OS_FIND_ROOTS_H
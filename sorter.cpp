@@ -0,0 +1,156 @@
+#include "sorter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <vector>
+
+bool sort_output = false;
+size_t sort_memory_budget = DEFAULT_SORT_MEMORY_BUDGET;
+
+namespace {
+
+struct SortedResult {
+    std::string path;
+    uint32_t dir_length;
+    EntryInfo info;
+};
+
+// Spilled as: u32 path length, u32 directory length, EntryInfo, path bytes
+struct RecordHeader {
+    uint32_t path_length;
+    uint32_t dir_length;
+    EntryInfo info;
+};
+
+struct FileCloser {
+    void operator()(FILE* file) const { fclose(file); }
+};
+typedef std::unique_ptr<FILE, FileCloser> RunFile;
+
+std::vector<SortedResult> collected;
+size_t collected_bytes = 0;
+std::vector<RunFile> runs;
+bool spill_failed = false;
+
+bool path_less(SortedResult const& a, SortedResult const& b) {
+    return a.path < b.path;
+}
+
+// Writes the collected results as one sorted run to an unnamed temporary file
+void spill() {
+    std::sort(collected.begin(), collected.end(), path_less);
+    RunFile file(tmpfile());
+    bool written = file != nullptr;
+    for (size_t i = 0; i < collected.size() && written; i++) {
+        SortedResult const& result = collected[i];
+        RecordHeader header{static_cast<uint32_t>(result.path.size()), result.dir_length, result.info};
+        written = fwrite(&header, sizeof(header), 1, file.get()) == 1 &&
+                  fwrite(result.path.data(), 1, result.path.size(), file.get()) == result.path.size();
+    }
+    if (!written || fflush(file.get()) != 0 || fseek(file.get(), 0, SEEK_SET) != 0) {
+        if (!spill_failed) {
+            std::cerr << "Error writing sorted results to a temporary file" << std::endl;
+            std::cerr << strerror(errno) << std::endl;
+            spill_failed = true;
+        }
+        // keeping the results in memory is better than losing them
+        return;
+    }
+    runs.push_back(std::move(file));
+    collected.clear();
+    collected_bytes = 0;
+}
+
+// The next result of a run during the merge
+struct RunCursor {
+    size_t run;
+    SortedResult current;
+};
+
+bool read_record(FILE* file, SortedResult& result) {
+    RecordHeader header{};
+    if (fread(&header, sizeof(header), 1, file) != 1) {
+        return false;
+    }
+    result.path.resize(header.path_length);
+    result.dir_length = header.dir_length;
+    result.info = header.info;
+    return fread(&result.path[0], 1, header.path_length, file) == header.path_length;
+}
+
+void pass(SortedResult const& result, MatchCallback on_result) {
+    std::string dir_path = result.path.substr(0, result.dir_length);
+    on_result(dir_path, result.path.c_str() + result.dir_length, result.info);
+}
+
+} // namespace
+
+void sort_add(std::string const& dir_path, const char* name, EntryInfo const& info) {
+    collected.push_back(SortedResult{dir_path + name, static_cast<uint32_t>(dir_path.size()), info});
+    collected_bytes += sizeof(SortedResult) + collected.back().path.capacity();
+    if (collected_bytes >= sort_memory_budget && !spill_failed) {
+        spill();
+    }
+}
+
+bool sort_finish(MatchCallback on_result) {
+    std::sort(collected.begin(), collected.end(), path_less);
+    if (runs.empty()) {
+        for (auto const& result : collected) {
+            pass(result, on_result);
+        }
+        collected.clear();
+        return true;
+    }
+
+    // k-way merge of the runs and of the results still in memory, which act as one more run
+    auto later = [](RunCursor const* a, RunCursor const* b) { return b->current.path < a->current.path; };
+    std::priority_queue<RunCursor*, std::vector<RunCursor*>, decltype(later)> heap(later);
+    std::vector<RunCursor> cursors(runs.size() + 1);
+    for (size_t i = 0; i < runs.size(); i++) {
+        cursors[i].run = i;
+        if (read_record(runs[i].get(), cursors[i].current)) {
+            heap.push(&cursors[i]);
+        }
+    }
+    size_t in_memory = 0;
+    RunCursor& memory_cursor = cursors.back();
+    memory_cursor.run = runs.size();
+    if (in_memory < collected.size()) {
+        memory_cursor.current = std::move(collected[in_memory++]);
+        heap.push(&memory_cursor);
+    }
+
+    bool read_failed = false;
+    while (!heap.empty()) {
+        RunCursor* cursor = heap.top();
+        heap.pop();
+        pass(cursor->current, on_result);
+        bool more;
+        if (cursor->run == runs.size()) {
+            more = in_memory < collected.size();
+            if (more) {
+                cursor->current = std::move(collected[in_memory++]);
+            }
+        } else {
+            more = read_record(runs[cursor->run].get(), cursor->current);
+            read_failed = read_failed || (!more && ferror(runs[cursor->run].get()));
+        }
+        if (more) {
+            heap.push(cursor);
+        }
+    }
+    collected.clear();
+    runs.clear();
+    if (read_failed) {
+        std::cerr << "Error reading sorted results from a temporary file" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef OS_FIND_SORTER_H
+#define OS_FIND_SORTER_H
+
+#include <cstddef>
+#include <string>
+
+#include "entry.h"
+#include "index.h"
+
+// -sort: results are output ordered bytewise by path
+extern bool sort_output;
+// -sort-memory: bytes of results kept in memory before a sorted run is spilled to disk
+const size_t DEFAULT_SORT_MEMORY_BUDGET = 256u << 20;
+extern size_t sort_memory_budget;
+
+// Collects a result whose position in the output is not known yet.
+// Not thread-safe, the caller serializes the calls.
+void sort_add(std::string const& dir_path, const char* name, EntryInfo const& info);
+
+// Sorts what was collected and passes it to on_result in order. Results that did not fit
+// into the memory budget were written to temporary files as sorted runs, which are now
+// merged with the results in memory.
+bool sort_finish(MatchCallback on_result);
+
+#endif //OS_FIND_SORTER_H
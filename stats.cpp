@@ -0,0 +1,213 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+
+#include "progress.h"
+
+StatsMode stats_mode = StatsMode::NONE;
+thread_local Stats run_stats{};
+
+namespace {
+
+std::mutex merge_mutex;
+// initialized by the main thread
+Stats* const main_stats = &run_stats;
+
+const char* const SYSCALL_NAMES[] = {"getdents64", "openat", "fstat", "close", "writev", "statx"};
+const char* const PHASE_NAMES[] = {"traversal", "output"};
+
+int bucket_of(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return static_cast<int>(value);
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    int sub = static_cast<int>((value >> (exponent - 2)) & (HISTOGRAM_SUB_BUCKETS - 1));
+    return (exponent - 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+double per_second(uint64_t count, uint64_t ns) {
+    return ns == 0 ? 0.0 : static_cast<double>(count) * 1e9 / static_cast<double>(ns);
+}
+
+double to_us(uint64_t ns) {
+    return static_cast<double>(ns) / 1e3;
+}
+
+} // namespace
+
+void Histogram::record(uint64_t value) {
+    counts[bucket_of(value)]++;
+    if (value > max) {
+        max = value;
+    }
+}
+
+uint64_t Histogram::bucket_floor(int bucket) {
+    if (bucket < HISTOGRAM_SUB_BUCKETS) {
+        return static_cast<uint64_t>(bucket);
+    }
+    int exponent = bucket / HISTOGRAM_SUB_BUCKETS + 1;
+    uint64_t sub = static_cast<uint64_t>(bucket % HISTOGRAM_SUB_BUCKETS);
+    return (HISTOGRAM_SUB_BUCKETS + sub) << (exponent - 2);
+}
+
+// returns the highest value equivalent to the bucket holding the percentile
+uint64_t Histogram::percentile(uint64_t total, double fraction) const {
+    if (total == 0) {
+        return 0;
+    }
+    auto wanted = static_cast<uint64_t>(fraction * static_cast<double>(total));
+    if (wanted == 0) {
+        wanted = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= wanted) {
+            if (i + 1 == HISTOGRAM_BUCKETS) {
+                return max;
+            }
+            uint64_t upper = bucket_floor(i + 1) - 1;
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
+
+void record_syscall(Syscall call, uint64_t start_ns, bool failed, uint64_t bytes) {
+    uint64_t elapsed = now_ns() - start_ns;
+    SyscallStats& s = run_stats.syscalls[static_cast<int>(call)];
+    s.calls++;
+    if (failed) {
+        s.errors++;
+    }
+    s.bytes += bytes;
+    s.total_ns += elapsed;
+    s.latency.record(elapsed);
+}
+
+void merge_thread_stats() {
+    std::lock_guard<std::mutex> guard(merge_mutex);
+    for (int i = 0; i < static_cast<int>(Syscall::COUNT); i++) {
+        SyscallStats& into = main_stats->syscalls[i];
+        SyscallStats const& from = run_stats.syscalls[i];
+        into.calls += from.calls;
+        into.errors += from.errors;
+        into.bytes += from.bytes;
+        into.total_ns += from.total_ns;
+        for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+            into.latency.counts[bucket] += from.latency.counts[bucket];
+        }
+        into.latency.max = std::max(into.latency.max, from.latency.max);
+    }
+    for (int i = 0; i < static_cast<int>(Phase::COUNT); i++) {
+        main_stats->phase_ns[i] += run_stats.phase_ns[i];
+    }
+    main_stats->dirent_bytes += run_stats.dirent_bytes;
+}
+
+PhaseTimer::PhaseTimer(Phase phase) : phase(phase), start_ns(stats_enabled() ? now_ns() : 0) {}
+
+PhaseTimer::~PhaseTimer() {
+    if (stats_enabled()) {
+        run_stats.phase_ns[static_cast<int>(phase)] += now_ns() - start_ns;
+    }
+}
+
+namespace {
+
+void print_text(std::ostream& out) {
+    uint64_t directories = counter_total(&TraversalCounters::directories);
+    uint64_t entries = counter_total(&TraversalCounters::entries);
+    uint64_t traversal_ns = run_stats.phase_ns[static_cast<int>(Phase::TRAVERSAL)];
+
+    out << "os_find stats" << "\n";
+    for (int i = 0; i < static_cast<int>(Phase::COUNT); i++) {
+        out << "  " << std::left << std::setw(12) << PHASE_NAMES[i] << std::right
+            << std::fixed << std::setprecision(3) << static_cast<double>(run_stats.phase_ns[i]) / 1e6 << " ms\n";
+    }
+    out << std::setprecision(0)
+        << "  directories " << directories << " (" << per_second(directories, traversal_ns) << "/s)\n"
+        << "  entries     " << entries << " (" << per_second(entries, traversal_ns) << "/s)\n"
+        << "  dirent bytes " << run_stats.dirent_bytes << "\n";
+
+    out << "  " << std::left << std::setw(12) << "syscall" << std::right
+        << std::setw(12) << "calls" << std::setw(8) << "errors" << std::setw(14) << "bytes"
+        << std::setw(12) << "total ms" << std::setw(10) << "mean us" << std::setw(10) << "p50 us"
+        << std::setw(10) << "p99 us" << std::setw(10) << "p99.9 us" << std::setw(10) << "max us" << "\n";
+    for (int i = 0; i < static_cast<int>(Syscall::COUNT); i++) {
+        SyscallStats const& s = run_stats.syscalls[i];
+        if (s.calls == 0) {
+            continue;
+        }
+        out << "  " << std::left << std::setw(12) << SYSCALL_NAMES[i] << std::right
+            << std::setw(12) << s.calls << std::setw(8) << s.errors << std::setw(14) << s.bytes
+            << std::setprecision(3)
+            << std::setw(12) << static_cast<double>(s.total_ns) / 1e6
+            << std::setw(10) << to_us(s.total_ns / s.calls)
+            << std::setw(10) << to_us(s.latency.percentile(s.calls, 0.5))
+            << std::setw(10) << to_us(s.latency.percentile(s.calls, 0.99))
+            << std::setw(10) << to_us(s.latency.percentile(s.calls, 0.999))
+            << std::setw(10) << to_us(s.latency.max) << "\n";
+    }
+    out << std::flush;
+}
+
+void print_json(std::ostream& out) {
+    uint64_t directories = counter_total(&TraversalCounters::directories);
+    uint64_t entries = counter_total(&TraversalCounters::entries);
+    uint64_t traversal_ns = run_stats.phase_ns[static_cast<int>(Phase::TRAVERSAL)];
+
+    out << "{\"phases_ns\":{";
+    for (int i = 0; i < static_cast<int>(Phase::COUNT); i++) {
+        out << (i == 0 ? "" : ",") << "\"" << PHASE_NAMES[i] << "\":" << run_stats.phase_ns[i];
+    }
+    out << "},\"directories\":" << directories
+        << ",\"entries\":" << entries
+        << ",\"dirent_bytes\":" << run_stats.dirent_bytes
+        << std::fixed << std::setprecision(1)
+        << ",\"directories_per_sec\":" << per_second(directories, traversal_ns)
+        << ",\"entries_per_sec\":" << per_second(entries, traversal_ns)
+        << ",\"syscalls\":{";
+    for (int i = 0; i < static_cast<int>(Syscall::COUNT); i++) {
+        SyscallStats const& s = run_stats.syscalls[i];
+        out << (i == 0 ? "" : ",") << "\"" << SYSCALL_NAMES[i] << "\":{"
+            << "\"calls\":" << s.calls
+            << ",\"errors\":" << s.errors
+            << ",\"bytes\":" << s.bytes
+            << ",\"total_ns\":" << s.total_ns
+            << ",\"p50_ns\":" << s.latency.percentile(s.calls, 0.5)
+            << ",\"p99_ns\":" << s.latency.percentile(s.calls, 0.99)
+            << ",\"p999_ns\":" << s.latency.percentile(s.calls, 0.999)
+            << ",\"max_ns\":" << s.latency.max
+            << ",\"histogram\":[";
+        // only non-empty buckets, as [lowest value in bucket, count] pairs
+        bool first = true;
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            if (s.latency.counts[b] == 0) {
+                continue;
+            }
+            out << (first ? "" : ",") << "[" << Histogram::bucket_floor(b) << "," << s.latency.counts[b] << "]";
+            first = false;
+        }
+        out << "]}";
+    }
+    out << "}}" << std::endl;
+}
+
+} // namespace
+
+void print_stats(std::ostream& out) {
+    switch (stats_mode) {
+        case StatsMode::TEXT:
+            print_text(out);
+            break;
+        case StatsMode::JSON:
+            print_json(out);
+            break;
+        case StatsMode::NONE:
+            break;
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef OS_FIND_STATS_H
+#define OS_FIND_STATS_H
+
+#include <cstdint>
+#include <ctime>
+#include <ostream>
+
+enum class Syscall {
+    GETDENTS,
+    OPENAT,
+    FSTAT,
+    CLOSE,
+    WRITE,
+    STATX,
+    COUNT
+};
+
+enum class Phase {
+    TRAVERSAL,
+    OUTPUT,
+    COUNT
+};
+
+// Every power of two is split into this many linear sub-buckets,
+// which keeps the relative error of reported latencies under 25%.
+const int HISTOGRAM_SUB_BUCKETS = 4;
+const int HISTOGRAM_BUCKETS = 64 * HISTOGRAM_SUB_BUCKETS;
+
+struct Histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t max;
+
+    void record(uint64_t value);
+    // lowest value that falls into the bucket
+    static uint64_t bucket_floor(int bucket);
+    uint64_t percentile(uint64_t total, double fraction) const;
+};
+
+struct SyscallStats {
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t bytes;
+    uint64_t total_ns;
+    Histogram latency;
+};
+
+struct Stats {
+    SyscallStats syscalls[static_cast<int>(Syscall::COUNT)];
+    uint64_t phase_ns[static_cast<int>(Phase::COUNT)];
+    uint64_t dirent_bytes;
+};
+
+enum class StatsMode {
+    NONE,
+    TEXT,
+    JSON
+};
+
+// Checked before any clock is read, so a run without --stats
+// pays for a single well predicted branch per syscall.
+extern StatsMode stats_mode;
+// Stats of the calling thread. Threads other than the main one merge theirs
+// into the stats of the main thread before they exit.
+extern thread_local Stats run_stats;
+
+void merge_thread_stats();
+
+inline bool stats_enabled() {
+    return stats_mode != StatsMode::NONE;
+}
+
+inline uint64_t now_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Records a syscall started at start_ns. Only called when stats are enabled.
+void record_syscall(Syscall call, uint64_t start_ns, bool failed, uint64_t bytes = 0);
+
+// Measures the lifetime of the object as the given phase
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Phase phase);
+    ~PhaseTimer();
+    PhaseTimer(PhaseTimer const&) = delete;
+    PhaseTimer& operator=(PhaseTimer const&) = delete;
+
+private:
+    Phase phase;
+    uint64_t start_ns;
+};
+
+void print_stats(std::ostream& out);
+
+#endif //OS_FIND_STATS_H
@@ -0,0 +1,94 @@
+#include "top.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+size_t top_count = 0;
+TopKey top_key = TopKey::SIZE;
+
+namespace {
+
+struct Kept {
+    int64_t key;
+    std::string path;
+    uint32_t dir_length;
+    EntryInfo info;
+};
+
+// true if a goes before b in the output
+bool better(Kept const& a, Kept const& b) {
+    return a.key > b.key || (a.key == b.key && a.path < b.path);
+}
+
+// a heap by better(), so that the worst kept file is on top
+struct TopHeap {
+    std::vector<Kept> kept;
+};
+
+std::mutex heaps_mutex;
+std::vector<std::unique_ptr<TopHeap>> heaps;
+thread_local TopHeap* thread_heap = nullptr;
+
+int64_t key_of(EntryInfo const& info) {
+    if (top_key == TopKey::SIZE) {
+        return info.stats.st_size;
+    }
+    return static_cast<int64_t>(info.stats.st_mtim.tv_sec) * 1000000000 + info.stats.st_mtim.tv_nsec;
+}
+
+} // namespace
+
+bool parse_top_key(std::string const& name) {
+    if (name == "size") {
+        top_key = TopKey::SIZE;
+    } else if (name == "mtime") {
+        top_key = TopKey::MTIME;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void top_add(std::string const& dir_path, const char* name, EntryInfo const& info) {
+    if (thread_heap == nullptr) {
+        // the heaps outlive the threads, to be merged by top_finish()
+        std::lock_guard<std::mutex> guard(heaps_mutex);
+        heaps.emplace_back(new TopHeap());
+        thread_heap = heaps.back().get();
+    }
+    std::vector<Kept>& kept = thread_heap->kept;
+    int64_t key = key_of(info);
+    if (kept.size() == top_count && key < kept.front().key) {
+        return;
+    }
+
+    Kept candidate{key, dir_path + name, static_cast<uint32_t>(dir_path.size()), info};
+    if (kept.size() < top_count) {
+        kept.push_back(std::move(candidate));
+        std::push_heap(kept.begin(), kept.end(), better);
+    } else if (better(candidate, kept.front())) {
+        std::pop_heap(kept.begin(), kept.end(), better);
+        kept.back() = std::move(candidate);
+        std::push_heap(kept.begin(), kept.end(), better);
+    }
+}
+
+void top_finish(MatchCallback on_result) {
+    std::vector<Kept> all;
+    for (auto& heap : heaps) {
+        std::move(heap->kept.begin(), heap->kept.end(), std::back_inserter(all));
+    }
+    heaps.clear();
+    thread_heap = nullptr;
+
+    size_t count = std::min(all.size(), top_count);
+    std::partial_sort(all.begin(), all.begin() + count, all.end(), better);
+    for (size_t i = 0; i < count; i++) {
+        std::string dir_path = all[i].path.substr(0, all[i].dir_length);
+        on_result(dir_path, all[i].path.c_str() + all[i].dir_length, all[i].info);
+    }
+}
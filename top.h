@@ -0,0 +1,37 @@
+#ifndef OS_FIND_TOP_H
+#define OS_FIND_TOP_H
+
+#include <cstddef>
+#include <string>
+
+#include "entry.h"
+#include "index.h"
+
+enum class TopKey {
+    SIZE,
+    MTIME
+};
+
+// -top N: only the N largest (or newest, with -by mtime) matched files are output,
+// largest first; 0 if not used
+extern size_t top_count;
+// -by
+extern TopKey top_key;
+
+inline bool top_enabled() {
+    return top_count != 0;
+}
+
+// Parses size or mtime
+bool parse_top_key(std::string const& name);
+
+// Offers a matched file, with its stats. Needs no lock: every thread keeps a heap of
+// the N best files it was offered, and most files are turned down by one comparison
+// with the worst of them.
+void top_add(std::string const& dir_path, const char* name, EntryInfo const& info);
+
+// Merges the heaps of all threads and passes the N best files to on_result, best first.
+// Files with the same key are ordered by path. Called once the threads are done.
+void top_finish(MatchCallback on_result);
+
+#endif //OS_FIND_TOP_H
@@ -0,0 +1,120 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+uint64_t trace_threshold_ns = 0;
+size_t trace_top = DEFAULT_TRACE_TOP;
+std::string trace_json_path;
+
+namespace {
+
+struct SlowEvent {
+    SlowKind kind;
+    std::string path;
+    uint64_t entries;
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+    uint32_t thread_id;
+};
+
+std::mutex events_mutex;
+std::vector<SlowEvent> events;
+const uint64_t trace_origin_ns = now_ns();
+std::atomic<uint32_t> next_thread_id{1};
+
+// Numbers the threads in the order they record their first event, so that the events
+// of different threads are laid out on separate tracks of the viewer
+uint32_t current_thread_id() {
+    static thread_local uint32_t thread_id = next_thread_id.fetch_add(1);
+    return thread_id;
+}
+
+const char* kind_name(SlowKind kind) {
+    return kind == SlowKind::DIRECTORY ? "directory" : "stat";
+}
+
+void write_json_string(std::ostream& out, std::string const& value) {
+    out << '"';
+    for (char c : value) {
+        auto byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (byte < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(byte)
+                << std::dec << std::setfill(' ');
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+void write_chrome_trace(std::ostream& out) {
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    for (auto const& event : events) {
+        out << (first ? "" : ",") << "\n{\"name\":";
+        write_json_string(out, event.path);
+        out << ",\"cat\":\"" << kind_name(event.kind) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread_id
+            << std::fixed << std::setprecision(3)
+            << ",\"ts\":" << static_cast<double>(event.start_ns - trace_origin_ns) / 1e3
+            << ",\"dur\":" << static_cast<double>(event.elapsed_ns) / 1e3
+            << ",\"args\":{\"entries\":" << event.entries << "}}";
+        first = false;
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}" << std::endl;
+}
+
+} // namespace
+
+void record_slow(SlowKind kind, std::string const& path, uint64_t entries, uint64_t start_ns, uint64_t elapsed_ns) {
+    if (elapsed_ns < trace_threshold_ns) {
+        return;
+    }
+    uint32_t thread_id = current_thread_id();
+    std::lock_guard<std::mutex> guard(events_mutex);
+    events.push_back(SlowEvent{kind, path, entries, start_ns, elapsed_ns, thread_id});
+}
+
+void print_trace_report() {
+    if (!trace_enabled()) {
+        return;
+    }
+
+    if (!trace_json_path.empty()) {
+        std::ofstream out(trace_json_path);
+        write_chrome_trace(out);
+        if (!out) {
+            std::cerr << "Error writing trace to " << trace_json_path << std::endl;
+            std::cerr << strerror(errno) << std::endl;
+        }
+        return;
+    }
+
+    size_t shown = std::min(trace_top, events.size());
+    std::partial_sort(events.begin(), events.begin() + shown, events.end(),
+                      [](SlowEvent const& a, SlowEvent const& b) { return a.elapsed_ns > b.elapsed_ns; });
+
+    std::cerr << events.size() << " operations slower than "
+              << std::fixed << std::setprecision(1) << static_cast<double>(trace_threshold_ns) / 1e6 << " ms";
+    if (shown < events.size()) {
+        std::cerr << ", slowest " << shown;
+    }
+    std::cerr << "\n" << std::setw(12) << "ms" << std::setw(10) << "entries" << "  "
+              << std::left << std::setw(10) << "kind" << std::right << "path" << "\n";
+    for (size_t i = 0; i < shown; i++) {
+        SlowEvent const& event = events[i];
+        std::cerr << std::setw(12) << std::setprecision(3) << static_cast<double>(event.elapsed_ns) / 1e6
+                  << std::setw(10) << event.entries << "  "
+                  << std::left << std::setw(10) << kind_name(event.kind) << std::right << event.path << "\n";
+    }
+    std::cerr << std::flush;
+}
@@ -0,0 +1,31 @@
+#ifndef OS_FIND_TRACE_H
+#define OS_FIND_TRACE_H
+
+#include <cstdint>
+#include <string>
+
+#include "stats.h"
+
+enum class SlowKind {
+    DIRECTORY,  // open of the directory plus all its getdents64 calls
+    STAT        // statx of a single entry
+};
+
+// 0 disables tracing
+extern uint64_t trace_threshold_ns;
+const size_t DEFAULT_TRACE_TOP = 20;
+extern size_t trace_top;
+// when not empty, the trace is written there as Chrome trace-event JSON
+extern std::string trace_json_path;
+
+inline bool trace_enabled() {
+    return trace_threshold_ns != 0;
+}
+
+// Keeps the operation if it took at least trace_threshold_ns
+void record_slow(SlowKind kind, std::string const& path, uint64_t entries, uint64_t start_ns, uint64_t elapsed_ns);
+
+// Prints the top trace_top slowest operations to stderr or writes the JSON trace
+void print_trace_report();
+
+#endif //OS_FIND_TRACE_H
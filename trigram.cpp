@@ -0,0 +1,400 @@
+#include "trigram.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <unordered_map>
+#include <vector>
+
+#include "directory.h"
+#include "fd.h"
+#include "links.h"
+#include "mapped_file.h"
+#include "output.h"
+#include "predicates.h"
+#include "progress.h"
+#include "top.h"
+#include "varint.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+namespace {
+
+const char TRIGRAM_MAGIC[8] = {'O', 'S', 'F', 'T', 'R', 'I', 'G', 'R'};
+const uint32_t TRIGRAM_VERSION = 1;
+const char NAME_START = '\1';
+const char NAME_END = '\2';
+
+struct TrigramHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t directory_count;
+    uint64_t entry_count;
+    uint64_t trigram_count;
+    uint64_t directory_offsets_offset;  // directory_count + 1 offsets into the paths
+    uint64_t paths_offset;
+    uint64_t entry_directories_offset;  // u32 per entry
+    uint64_t inodes_offset;
+    uint64_t types_offset;
+    uint64_t name_offsets_offset;       // entry_count + 1 offsets into the names
+    uint64_t names_offset;
+    uint64_t trigrams_offset;           // TrigramRecord sorted by trigram
+    uint64_t postings_offset;
+    uint64_t file_size;
+};
+
+struct TrigramRecord {
+    uint32_t trigram;
+    uint32_t count;
+    uint64_t offset;  // into the postings
+};
+
+uint32_t trigram_at(const char* text) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(text[0])) << 16 |
+           static_cast<uint32_t>(static_cast<unsigned char>(text[1])) << 8 |
+           static_cast<uint32_t>(static_cast<unsigned char>(text[2]));
+}
+
+// Splits a shell pattern into the literal runs every matching name contains.
+// The start and end markers are added where the pattern is anchored.
+std::vector<string> literal_fragments(string const& pattern) {
+    std::vector<string> fragments;
+    string current(1, NAME_START);
+    for (size_t i = 0; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if (c == '*' || c == '?' || c == '[') {
+            fragments.push_back(current);
+            current.clear();
+            if (c == '[') {
+                // skip the bracket expression; ']' right after '[' or '[!' is part of it
+                size_t j = i + 1;
+                if (j < pattern.size() && (pattern[j] == '!' || pattern[j] == '^')) {
+                    j++;
+                }
+                if (j < pattern.size() && pattern[j] == ']') {
+                    j++;
+                }
+                while (j < pattern.size() && pattern[j] != ']') {
+                    j++;
+                }
+                i = j;
+            }
+        } else if (c == '\\' && i + 1 < pattern.size()) {
+            current += pattern[++i];
+        } else {
+            current += c;
+        }
+    }
+    current += NAME_END;
+    fragments.push_back(current);
+    return fragments;
+}
+
+class TrigramBuilder {
+public:
+    void directory(int dir_fd, string const& path) {
+        auto dir_id = static_cast<uint32_t>(directory_offsets.size());
+        directory_offsets.push_back(paths.size());
+        paths.insert(paths.end(), path.begin(), path.end());
+        bump(traversal_counters.directories);
+        if (progress_enabled()) {
+            set_current_directory(path);
+        }
+
+        std::vector<ListedEntry> entries;
+        if (!list_directory(dir_fd, entries)) {
+            cerr << "Error reading contents of " << path << endl;
+            print_error();
+            return;
+        }
+
+        std::vector<ListedEntry const*> subdirectories;
+        for (auto const& entry : entries) {
+            bump(traversal_counters.entries);
+            unsigned char type = entry.type;
+            if (type == DT_UNKNOWN) {
+                type = entry_type(dir_fd, entry.name.c_str());
+            }
+            if (type == DT_DIR) {
+                subdirectories.push_back(&entry);
+            } else {
+                add(dir_id, entry, type);
+            }
+        }
+
+        for (auto entry : subdirectories) {
+            FileDescriptor fd = open_directory(dir_fd, entry->name.c_str());
+            if (!fd.valid()) {
+                cerr << "Error reading contents of " << path << entry->name << "/" << endl;
+                print_error();
+                continue;
+            }
+            directory(fd.get(), path + entry->name + "/");
+        }
+    }
+
+    bool write(string const& db_path) {
+        directory_offsets.push_back(paths.size());
+        name_offsets.push_back(names.size());
+
+        std::vector<uint32_t> keys;
+        keys.reserve(postings.size());
+        for (auto const& posting : postings) {
+            keys.push_back(posting.first);
+        }
+        std::sort(keys.begin(), keys.end());
+
+        TrigramHeader header{};
+        memcpy(header.magic, TRIGRAM_MAGIC, sizeof(TRIGRAM_MAGIC));
+        header.version = TRIGRAM_VERSION;
+        header.directory_count = directory_offsets.size() - 1;
+        header.entry_count = inodes.size();
+        header.trigram_count = keys.size();
+
+        SectionWriter writer;
+        if (!writer.open(db_path)) {
+            return false;
+        }
+        writer.section(&header, sizeof(header));
+        header.directory_offsets_offset = writer.section(directory_offsets.data(),
+                                                         directory_offsets.size() * sizeof(uint64_t));
+        header.paths_offset = writer.section(paths.data(), paths.size());
+        header.entry_directories_offset = writer.section(entry_directories.data(),
+                                                         entry_directories.size() * sizeof(uint32_t));
+        header.inodes_offset = writer.section(inodes.data(), inodes.size() * sizeof(uint64_t));
+        header.types_offset = writer.section(types.data(), types.size());
+        header.name_offsets_offset = writer.section(name_offsets.data(), name_offsets.size() * sizeof(uint64_t));
+        header.names_offset = writer.section(names.data(), names.size());
+
+        std::vector<TrigramRecord> records;
+        records.reserve(keys.size());
+        std::vector<char> all_postings;
+        for (uint32_t key : keys) {
+            Posting const& posting = postings[key];
+            records.push_back(TrigramRecord{key, posting.count, all_postings.size()});
+            all_postings.insert(all_postings.end(), posting.bytes.begin(), posting.bytes.end());
+        }
+        postings.clear();
+        header.trigrams_offset = writer.section(records.data(), records.size() * sizeof(TrigramRecord));
+        header.postings_offset = writer.section(all_postings.data(), all_postings.size());
+        header.file_size = writer.size();
+        return writer.commit(&header, sizeof(header));
+    }
+
+private:
+    struct Posting {
+        std::vector<char> bytes;
+        uint64_t last = 0;
+        uint32_t count = 0;
+    };
+
+    void add(uint32_t dir_id, ListedEntry const& entry, unsigned char type) {
+        uint64_t id = inodes.size();
+        entry_directories.push_back(dir_id);
+        inodes.push_back(entry.ino);
+        types.push_back(type);
+        name_offsets.push_back(names.size());
+        names.insert(names.end(), entry.name.begin(), entry.name.end());
+
+        marked.assign(1, NAME_START);
+        marked += entry.name;
+        marked += NAME_END;
+        for (size_t i = 0; i + 3 <= marked.size(); i++) {
+            Posting& posting = postings[trigram_at(marked.data() + i)];
+            // a trigram repeated inside one name is stored once
+            if (posting.count > 0 && posting.last == id) {
+                continue;
+            }
+            put_varint(posting.bytes, id - posting.last);
+            posting.last = id;
+            posting.count++;
+        }
+    }
+
+    std::vector<uint64_t> directory_offsets;
+    std::vector<char> paths;
+    std::vector<uint32_t> entry_directories;
+    std::vector<uint64_t> inodes;
+    std::vector<uint8_t> types;
+    std::vector<uint64_t> name_offsets;
+    std::vector<char> names;
+    std::unordered_map<uint32_t, Posting> postings;
+    string marked;
+};
+
+class TrigramReader {
+public:
+    bool open(string const& db_path) {
+        if (!file.open(db_path)) {
+            return false;
+        }
+        const char* mapping = file.data();
+        header = reinterpret_cast<TrigramHeader const*>(mapping);
+        if (file.size() < sizeof(TrigramHeader) ||
+            memcmp(header->magic, TRIGRAM_MAGIC, sizeof(TRIGRAM_MAGIC)) != 0 ||
+            header->version != TRIGRAM_VERSION || header->file_size != file.size()) {
+            cerr << db_path << " is not an os_find trigram index of version " << TRIGRAM_VERSION << endl;
+            return false;
+        }
+        directory_offsets = reinterpret_cast<uint64_t const*>(mapping + header->directory_offsets_offset);
+        paths = mapping + header->paths_offset;
+        entry_directories = reinterpret_cast<uint32_t const*>(mapping + header->entry_directories_offset);
+        inodes = reinterpret_cast<uint64_t const*>(mapping + header->inodes_offset);
+        types = reinterpret_cast<uint8_t const*>(mapping + header->types_offset);
+        name_offsets = reinterpret_cast<uint64_t const*>(mapping + header->name_offsets_offset);
+        names = mapping + header->names_offset;
+        trigrams = reinterpret_cast<TrigramRecord const*>(mapping + header->trigrams_offset);
+        postings = mapping + header->postings_offset;
+        return true;
+    }
+
+    void query(string const& prefix, MatchCallback on_match) {
+        std::vector<uint64_t> candidates;
+        bool all = !select_candidates(candidates);
+        uint64_t count = all ? header->entry_count : candidates.size();
+
+        bool need_stats = predicates_need_stats() || output_needs_stats() || top_enabled() || group_links;
+        string name;
+        EntryInfo info{};
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t id = all ? i : candidates[i];
+            bump(traversal_counters.entries);
+            if (!type_wanted(types[id])) {
+                continue;
+            }
+            uint32_t dir = entry_directories[id];
+            const char* path = paths + directory_offsets[dir];
+            size_t path_length = directory_offsets[dir + 1] - directory_offsets[dir];
+            if (path_length < prefix.size() || prefix.compare(0, prefix.size(), path, prefix.size()) != 0) {
+                continue;
+            }
+            name.assign(names + name_offsets[id], name_offsets[id + 1] - name_offsets[id]);
+            if (!matches_dirent(inodes[id], name.c_str())) {
+                continue;
+            }
+
+            string dir_path(path, path_length);
+            info.ino = inodes[id];
+            info.type = types[id];
+            info.stats_mask = 0;
+            if (need_stats) {
+                // the trigram index has no stats, the candidate is checked on the file system
+                string full_path = dir_path + name;
+                if (stat_entry(AT_FDCWD, full_path.c_str(), STATX_BASIC_STATS, &info.stats, info.stats_mask) == -1) {
+                    continue;
+                }
+                if (!matches_stats(info.stats)) {
+                    continue;
+                }
+            }
+            on_match(dir_path, name.c_str(), info);
+        }
+    }
+
+private:
+    // Intersects the posting lists of the trigrams of the -name pattern, shortest first.
+    // Returns false if the pattern has no trigram and every entry is a candidate.
+    bool select_candidates(std::vector<uint64_t>& candidates) {
+        if (name_target.empty()) {
+            return false;
+        }
+        std::vector<uint32_t> keys;
+        for (auto const& fragment : literal_fragments(name_target)) {
+            for (size_t i = 0; i + 3 <= fragment.size(); i++) {
+                keys.push_back(trigram_at(fragment.data() + i));
+            }
+        }
+        if (keys.empty()) {
+            return false;
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        std::vector<TrigramRecord const*> lists;
+        for (uint32_t key : keys) {
+            TrigramRecord const* end = trigrams + header->trigram_count;
+            TrigramRecord const* found = std::lower_bound(trigrams, end, key,
+                                                          [](TrigramRecord const& record, uint32_t value) {
+                                                              return record.trigram < value;
+                                                          });
+            if (found == end || found->trigram != key) {
+                // no name has this trigram, so nothing can match
+                return true;
+            }
+            lists.push_back(found);
+        }
+        std::sort(lists.begin(), lists.end(), [](TrigramRecord const* a, TrigramRecord const* b) {
+            return a->count < b->count;
+        });
+
+        decode(*lists[0], candidates);
+        std::vector<uint64_t> next;
+        std::vector<uint64_t> kept;
+        for (size_t l = 1; l < lists.size() && !candidates.empty(); l++) {
+            next.clear();
+            decode(*lists[l], next);
+            kept.clear();
+            std::set_intersection(candidates.begin(), candidates.end(), next.begin(), next.end(),
+                                  std::back_inserter(kept));
+            candidates.swap(kept);
+        }
+        return true;
+    }
+
+    void decode(TrigramRecord const& record, std::vector<uint64_t>& ids) {
+        const char* in = postings + record.offset;
+        uint64_t id = 0;
+        ids.reserve(ids.size() + record.count);
+        for (uint32_t i = 0; i < record.count; i++) {
+            uint64_t delta;
+            in = get_varint(in, delta);
+            id += delta;
+            ids.push_back(id);
+        }
+    }
+
+    MappedFile file;
+    TrigramHeader const* header = nullptr;
+    uint64_t const* directory_offsets = nullptr;
+    const char* paths = nullptr;
+    uint32_t const* entry_directories = nullptr;
+    uint64_t const* inodes = nullptr;
+    uint8_t const* types = nullptr;
+    uint64_t const* name_offsets = nullptr;
+    const char* names = nullptr;
+    TrigramRecord const* trigrams = nullptr;
+    const char* postings = nullptr;
+};
+
+} // namespace
+
+bool build_trigram_index(string const& db_path, string const& root) {
+    FileDescriptor fd = open_directory(AT_FDCWD, root.c_str());
+    if (!fd.valid()) {
+        cerr << "Error reading contents of " << root << endl;
+        print_error();
+        return false;
+    }
+    TrigramBuilder builder;
+    builder.directory(fd.get(), root);
+    return builder.write(db_path);
+}
+
+bool query_trigram_index(string const& db_path, string const& prefix, MatchCallback on_match) {
+    TrigramReader reader;
+    if (!reader.open(db_path)) {
+        return false;
+    }
+    reader.query(prefix, on_match);
+    return true;
+}
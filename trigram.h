@@ -0,0 +1,21 @@
+#ifndef OS_FIND_TRIGRAM_H
+#define OS_FIND_TRIGRAM_H
+
+#include <string>
+
+#include "index.h"
+
+// Walks the tree under root (an absolute path ending with '/') and writes to db_path
+// a trigram index of the names of all entries that are not directories.
+// Every name is indexed as "\1name\2", so that the beginning and the end of a name are
+// trigrams too and short or anchored patterns can use the index. For every trigram the
+// ids of the entries containing it are kept sorted, delta and varint encoded.
+bool build_trigram_index(std::string const& db_path, std::string const& root);
+
+// Answers the predicates from the trigram index. The literal parts of the -name pattern
+// select the candidates by intersecting posting lists; each candidate is then checked with
+// the usual predicates, reading its stats from the file system if they are needed.
+// Only entries under prefix are reported.
+bool query_trigram_index(std::string const& db_path, std::string const& prefix, MatchCallback on_match);
+
+#endif //OS_FIND_TRIGRAM_H
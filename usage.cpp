@@ -0,0 +1,133 @@
+#include "usage.h"
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "fd.h"
+#include "inode_table.h"
+#include "output.h"
+
+bool disk_usage = false;
+bool usage_in_bytes = false;
+size_t usage_top = 0;
+
+namespace {
+
+const unsigned USAGE_MASK = STATX_TYPE | STATX_NLINK | STATX_INO | STATX_SIZE | STATX_BLOCKS;
+
+struct DirectoryTotal {
+    uint64_t total;
+    std::string path;
+};
+
+// the smallest of the kept directories on top, to be dropped for a larger one
+struct LargerTotal {
+    bool operator()(DirectoryTotal const& a, DirectoryTotal const& b) const {
+        return a.total > b.total || (a.total == b.total && a.path < b.path);
+    }
+};
+
+thread_local UsageScope* current_scope = nullptr;
+
+// only files with several links go in, which are few in most trees
+std::mutex linked_mutex;
+InodeTable linked_inodes;
+
+std::mutex report_mutex;
+std::priority_queue<DirectoryTotal, std::vector<DirectoryTotal>, LargerTotal> largest;
+
+void print_statx_error(std::string const& path) {
+    int saved_errno = errno;
+    std::cerr << "Error reading stats of file at " << path << std::endl;
+    std::cerr << strerror(saved_errno) << std::endl;
+}
+
+// du prints a directory without the trailing slash
+std::string printed_path(std::string const& path) {
+    return path.size() > 1 && path.back() == '/' ? path.substr(0, path.size() - 1) : path;
+}
+
+void emit_usage(uint64_t total, std::string const& path) {
+    std::string line = std::to_string(total);
+    line += '\t';
+    line += path;
+    line += output_format == OutputFormat::PRINT0 ? '\0' : '\n';
+    emit_text(line);
+}
+
+} // namespace
+
+void count_usage(int dir_fd, std::string const& dir_path, const char* name) {
+    struct statx stats{};
+    if (sys_statx(dir_fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, USAGE_MASK, &stats) == -1) {
+        print_statx_error(dir_path + name);
+        return;
+    }
+    if (stats.stx_nlink > 1) {
+        bool inserted;
+        std::lock_guard<std::mutex> guard(linked_mutex);
+        linked_inodes.insert(makedev(stats.stx_dev_major, stats.stx_dev_minor), stats.stx_ino, 0, inserted);
+        if (!inserted) {
+            return;
+        }
+    }
+    current_scope->blocks += stats.stx_blocks;
+    current_scope->bytes += stats.stx_size;
+}
+
+UsageScope::UsageScope(int dir_fd, std::string const& path) : path(path), parent(current_scope) {
+    if (!disk_usage) {
+        return;
+    }
+    current_scope = this;
+    struct statx stats{};
+    if (sys_statx(dir_fd, "", AT_EMPTY_PATH, USAGE_MASK, &stats) == -1) {
+        print_statx_error(path);
+        return;
+    }
+    blocks = stats.stx_blocks;
+    bytes = stats.stx_size;
+}
+
+UsageScope::~UsageScope() {
+    if (!disk_usage) {
+        return;
+    }
+    current_scope = parent;
+    if (parent != nullptr) {
+        parent->blocks += blocks;
+        parent->bytes += bytes;
+    }
+
+    // blocks are 512 bytes, du rounds KiB up
+    uint64_t total = usage_in_bytes ? bytes : (blocks + 1) / 2;
+    std::lock_guard<std::mutex> guard(report_mutex);
+    if (usage_top == 0) {
+        emit_usage(total, printed_path(path));
+    } else if (largest.size() < usage_top || total > largest.top().total) {
+        largest.push(DirectoryTotal{total, printed_path(path)});
+        if (largest.size() > usage_top) {
+            largest.pop();
+        }
+    }
+}
+
+void finish_usage() {
+    std::vector<DirectoryTotal> kept;
+    kept.reserve(largest.size());
+    for (; !largest.empty(); largest.pop()) {
+        kept.push_back(largest.top());
+    }
+    for (auto it = kept.rbegin(); it != kept.rend(); ++it) {
+        emit_usage(it->total, it->path);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef OS_FIND_USAGE_H
+#define OS_FIND_USAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// -du: instead of matching files, output the disk usage of every directory like du,
+// in KiB of allocated blocks, after the directories below it
+extern bool disk_usage;
+// -du-bytes: the apparent size in bytes instead, like du -b
+extern bool usage_in_bytes;
+// -du-top N: only the N largest directories, largest first; 0 outputs all of them
+extern size_t usage_top;
+
+// Counts a non-directory entry of the directory being visited by the calling thread.
+// A file with several hardlinks is only counted at its first path, like du does.
+void count_usage(int dir_fd, std::string const& dir_path, const char* name);
+
+// With -du, makes the directory the one being visited by the calling thread, for the
+// lifetime of the scope; does nothing otherwise. Its totals live here, so that threads
+// walking other directories never share them; at the end of the scope they are reported
+// and added to the enclosing directory.
+class UsageScope {
+public:
+    UsageScope(int dir_fd, std::string const& path);
+    UsageScope(UsageScope const&) = delete;
+    UsageScope& operator=(UsageScope const&) = delete;
+    ~UsageScope();
+
+private:
+    std::string const& path;
+    uint64_t blocks = 0;
+    uint64_t bytes = 0;
+    UsageScope* parent;
+
+    friend void count_usage(int dir_fd, std::string const& dir_path, const char* name);
+};
+
+// Outputs the largest directories for -du-top
+void finish_usage();
+
+#endif //OS_FIND_USAGE_H
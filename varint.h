@@ -0,0 +1,28 @@
+#ifndef OS_FIND_VARINT_H
+#define OS_FIND_VARINT_H
+
+#include <cstdint>
+#include <vector>
+
+// LEB128: 7 bits per byte, high bit set on all bytes but the last
+
+inline void put_varint(std::vector<char>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline const char* get_varint(const char* in, uint64_t& value) {
+    value = 0;
+    for (int shift = 0;; shift += 7) {
+        auto byte = static_cast<unsigned char>(*in++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return in;
+        }
+    }
+}
+
+#endif //OS_FIND_VARINT_H